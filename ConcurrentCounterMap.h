@@ -0,0 +1,232 @@
+#ifndef CONCURRENT_COUNTER_MAP_H
+#define CONCURRENT_COUNTER_MAP_H
+
+#include "ConcurrentHashMap.h"
+#include "LockPolicies.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+
+// Map of atomic counters, e.g. a metrics registry. Incrementing an existing key is a lock-free lookup
+// followed by a fetch_add; only creating a missing key takes the stripe lock. Keys are never removed,
+// so lookups need no reclamation scheme: nodes are published with release stores and freed with the map.
+// Very hot keys can be spread over per-CPU cells, trading a slower getCopy for uncontended increments.
+template<class Key, class Value = long, class Hash = std::hash<Key>, class LockPolicy = std::mutex>
+class ConcurrentCounterMap
+{
+    static_assert(std::is_integral<Value>::value, "Value must be an integer");
+
+    static const std::size_t CacheLineSize = 64;
+
+    struct Cell;
+    struct Node;
+
+public:
+    explicit ConcurrentCounterMap(
+        std::size_t capacity,
+        std::size_t concurrencyLevel = ConcurrencyLevelDefault,
+        const Hash& hasher = Hash()) :
+        mCapacity(capacity),
+        mMutexCount(getStripeCount(capacity, concurrencyLevel)),
+        mCellCount(std::max(1u, std::thread::hardware_concurrency())),
+        mHasher(hasher),
+        mSize(0),
+        mTable(new std::atomic<Node*>[capacity]),
+        mMutexes(new LockPolicy[mMutexCount])
+    {
+        for (std::size_t i = 0; i < mCapacity; ++i)
+            mTable[i].store(nullptr, std::memory_order_relaxed);
+    }
+
+    ~ConcurrentCounterMap()
+    {
+        for (std::size_t i = 0; i < mCapacity; ++i)
+        {
+            Node* node = mTable[i].load(std::memory_order_relaxed);
+            while (node)
+            {
+                Node* next = node->next;
+                destroyCells(node->cells.load(std::memory_order_relaxed));
+                delete node;
+                node = next;
+            }
+        }
+        delete[] mMutexes;
+        delete[] mTable;
+    }
+
+    std::size_t capacity() const
+    {
+        return mCapacity;
+    }
+
+    // Number of counters created so far
+    std::size_t size() const
+    {
+        return mSize;
+    }
+
+    bool find(const Key& key) const
+    {
+        return findNode(getIndex(key), key) != nullptr;
+    }
+
+    // Current value of the counter: the sum of its cells if it was spread. Increments running concurrently
+    // with the summation may or may not be included. Throws ConcurrentHashmapException if key not found.
+    Value getCopy(const Key& key) const
+    {
+        const Node* node = findNode(getIndex(key), key);
+        if (!node)
+            throw ConcurrentHashmapException(ConcurrentHashmapException::KeyNotFound);
+
+        Value result = node->value.load(std::memory_order_relaxed);
+        if (const Cell* cells = node->cells.load(std::memory_order_acquire))
+        {
+            for (std::size_t i = 0; i < mCellCount; ++i)
+                result += cells[i].value.load(std::memory_order_relaxed);
+        }
+        return result;
+    }
+
+    // Adds delta to the counter, creating it with value 0 first if the key is missing.
+    void increment(const Key& key, Value delta = 1)
+    {
+        Node* node = findOrCreateNode(key);
+        if (Cell* cells = node->cells.load(std::memory_order_acquire))
+            cells[currentCell()].value.fetch_add(delta, std::memory_order_relaxed);
+        else
+            node->value.fetch_add(delta, std::memory_order_relaxed);
+    }
+
+    // Gives the counter one cell per CPU, so threads on different CPUs increment different cache lines.
+    // Meant for the few hottest keys: every cell takes a cache line and getCopy has to sum all of them.
+    void spreadCounter(const Key& key)
+    {
+        Node* node = findOrCreateNode(key);
+        Cell* cells = createCells();
+        Cell* expected = nullptr;
+        if (!node->cells.compare_exchange_strong(expected, cells, std::memory_order_acq_rel, std::memory_order_acquire))
+            destroyCells(cells);
+    }
+
+private:
+    // noncopyable
+    ConcurrentCounterMap(const ConcurrentCounterMap&) = delete;
+    ConcurrentCounterMap& operator=(const ConcurrentCounterMap&) = delete;
+
+    std::size_t getIndex(const Key& key) const
+    {
+        return mHasher(key) % mCapacity;
+    }
+
+    // new only guarantees alignof(max_align_t) before C++17, so the cells are placed on a cache line by hand
+    Cell* createCells() const
+    {
+#if defined(_WIN32)
+        void* const memory = _aligned_malloc(mCellCount * sizeof(Cell), CacheLineSize);
+        if (!memory)
+            throw std::bad_alloc();
+#else
+        void* memory = nullptr;
+        if (posix_memalign(&memory, CacheLineSize, mCellCount * sizeof(Cell)) != 0)
+            throw std::bad_alloc();
+#endif
+        Cell* const cells = static_cast<Cell*>(memory);
+        for (std::size_t i = 0; i < mCellCount; ++i)
+            new (&cells[i]) Cell();
+        return cells;
+    }
+
+    // cells are trivially destructible, so only their memory is released
+    static void destroyCells(Cell* cells)
+    {
+#if defined(_WIN32)
+        _aligned_free(cells);
+#else
+        std::free(cells);
+#endif
+    }
+
+    std::size_t currentCell() const
+    {
+#if defined(__linux__)
+        const int cpu = sched_getcpu();
+        if (cpu >= 0)
+            return static_cast<std::size_t>(cpu) % mCellCount;
+#endif
+        return std::hash<std::thread::id>()(std::this_thread::get_id()) % mCellCount;
+    }
+
+    Node* findNode(std::size_t index, const Key& key) const
+    {
+        Node* node = mTable[index].load(std::memory_order_acquire);
+        while (node && node->key != key)
+            node = node->next;
+        return node;
+    }
+
+    Node* findOrCreateNode(const Key& key)
+    {
+        const std::size_t index = getIndex(key);
+        if (Node* node = findNode(index, key))
+            return node;
+
+        std::lock_guard<LockPolicy> lock(mMutexes[index % mMutexCount]);
+        // another thread may have created it before we got the lock
+        if (Node* node = findNode(index, key))
+            return node;
+
+        Node* node = new Node(key, mTable[index].load(std::memory_order_relaxed));
+        mTable[index].store(node, std::memory_order_release);
+        ++mSize;
+        return node;
+    }
+
+private:
+    const std::size_t mCapacity;
+    const std::size_t mMutexCount;
+    const std::size_t mCellCount;
+    const Hash mHasher;
+    std::atomic<std::size_t> mSize;
+    std::atomic<Node*>* mTable;
+    LockPolicy* mMutexes; // creation only, bucket index modulo mutex count
+};
+
+// Aligned and padded so that every cell has a cache line to itself.
+template<class Key, class Value, class Hash, class LockPolicy>
+struct alignas(ConcurrentCounterMap<Key, Value, Hash, LockPolicy>::CacheLineSize)
+    ConcurrentCounterMap<Key, Value, Hash, LockPolicy>::Cell
+{
+    Cell() : value(0) {}
+
+    std::atomic<Value> value;
+    char padding[CacheLineSize - sizeof(std::atomic<Value>)];
+};
+
+template<class Key, class Value, class Hash, class LockPolicy>
+struct ConcurrentCounterMap<Key, Value, Hash, LockPolicy>::Node
+{
+    Node(const Key& key, Node* next) : key(key), next(next), value(0), cells(nullptr) {}
+
+    const Key key;
+    Node* const next; // immutable once published, nodes are only pushed at the head
+    std::atomic<Value> value;
+    std::atomic<Cell*> cells; // per-CPU cells once the counter is spread
+};
+
+#endif
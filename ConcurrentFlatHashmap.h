@@ -0,0 +1,200 @@
+#ifndef CONCURRENT_FLAT_HASH_MAP_H
+#define CONCURRENT_FLAT_HASH_MAP_H
+
+#include "ConcurrentHashMap.h"
+
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+
+
+// Lock-free open-addressing map for integral keys and values of up to 64 bits.
+// Entries live in a flat array of 16-byte slots probed linearly: a key claims a slot with a single CAS
+// and keeps it for the lifetime of the map, values are read and updated with atomic operations in place.
+// Erasing marks the value absent and leaves the key in its slot as a tombstone, which a later insert
+// of the same key reuses, so capacity should account for every distinct key ever inserted.
+// The key and value that convert to ~0 as uint64_t (the maximum for unsigned types, -1 for signed ones)
+// are reserved for empty slots and absent values.
+template<class Key, class Value, class Hash = std::hash<Key>>
+class ConcurrentFlatHashmap
+{
+    static_assert(std::is_integral<Key>::value && sizeof(Key) <= sizeof(std::uint64_t), "Key must be an integer of up to 64 bits");
+    static_assert(std::is_integral<Value>::value && sizeof(Value) <= sizeof(std::uint64_t), "Value must be an integer of up to 64 bits");
+
+public:
+    // The slot count is the smallest power of two that keeps the load factor at or below 3/4 with capacity keys.
+    explicit ConcurrentFlatHashmap(std::size_t capacity, const Hash& hasher = Hash()) :
+        mSlotCount(getSlotCount(capacity)),
+        mHasher(hasher),
+        mSize(0),
+        mSlots(new Slot[mSlotCount])
+    {
+    }
+
+    ~ConcurrentFlatHashmap()
+    {
+        delete[] mSlots;
+    }
+
+    std::size_t capacity() const
+    {
+        return mSlotCount;
+    }
+
+    std::size_t size() const
+    {
+        return mSize;
+    }
+
+    bool find(const Key& key) const
+    {
+        const Slot* slot = findSlot(toWord(key));
+        return slot && slot->value.load(std::memory_order_acquire) != AbsentValue;
+    }
+
+    // Throws ConcurrentHashmapException if key not found.
+    Value getCopy(const Key& key) const
+    {
+        const Slot* slot = findSlot(toWord(key));
+        const std::uint64_t value = slot ? slot->value.load(std::memory_order_acquire) : AbsentValue;
+        if (value == AbsentValue)
+            throw ConcurrentHashmapException(ConcurrentHashmapException::KeyNotFound);
+        return static_cast<Value>(value);
+    }
+
+    // Throws ConcurrentHashmapException for reserved keys and values, and if there's no slot left for a new key.
+    void insert(const Key& key, const Value& value)
+    {
+        const std::uint64_t word = toWord(value);
+        if (word == AbsentValue)
+            throw ConcurrentHashmapException(ConcurrentHashmapException::ReservedValue);
+
+        if (claimSlot(toWord(key)).value.exchange(word, std::memory_order_acq_rel) == AbsentValue)
+            ++mSize;
+    }
+
+    void erase(const Key& key)
+    {
+        Slot* slot = findSlot(toWord(key));
+        if (slot && slot->value.exchange(AbsentValue, std::memory_order_acq_rel) != AbsentValue)
+            --mSize;
+    }
+
+    // Atomically adds delta to the key's value, inserting delta if the key is absent.
+    // Returns the previous value, 0 if the key was absent. Throws like insert.
+    Value fetchAdd(const Key& key, const Value& delta)
+    {
+        Slot& slot = claimSlot(toWord(key));
+        std::uint64_t current = slot.value.load(std::memory_order_relaxed);
+        std::uint64_t next;
+        do
+        {
+            const Value previous = current == AbsentValue ? Value() : static_cast<Value>(current);
+            next = toWord(static_cast<Value>(previous + delta));
+            if (next == AbsentValue)
+                throw ConcurrentHashmapException(ConcurrentHashmapException::ReservedValue);
+        }
+        while (!slot.value.compare_exchange_weak(current, next, std::memory_order_acq_rel, std::memory_order_relaxed));
+
+        if (current == AbsentValue)
+        {
+            ++mSize;
+            return Value();
+        }
+        return static_cast<Value>(current);
+    }
+
+private:
+    // noncopyable
+    ConcurrentFlatHashmap(const ConcurrentFlatHashmap&) = delete;
+    ConcurrentFlatHashmap& operator=(const ConcurrentFlatHashmap&) = delete;
+
+    static const std::uint64_t EmptyKey = ~0ull;
+    static const std::uint64_t AbsentValue = ~0ull;
+
+    struct alignas(16) Slot
+    {
+        Slot() : key(EmptyKey), value(AbsentValue) {}
+
+        std::atomic<std::uint64_t> key;
+        std::atomic<std::uint64_t> value;
+    };
+
+    static std::size_t getSlotCount(std::size_t capacity)
+    {
+        if (capacity == 0)
+            throw ConcurrentHashmapException(ConcurrentHashmapException::InvalidCapacity);
+
+        std::size_t slotCount = 1;
+        while (slotCount / 4 * 3 < capacity)
+            slotCount *= 2;
+        return slotCount;
+    }
+
+    template<class Integer>
+    static std::uint64_t toWord(Integer value)
+    {
+        return static_cast<std::uint64_t>(value);
+    }
+
+    // First probed slot. Fibonacci hashing spreads the identity hashes std::hash gives integers.
+    std::size_t getIndex(std::uint64_t key) const
+    {
+        const std::uint64_t hash = static_cast<std::uint64_t>(mHasher(static_cast<Key>(key)));
+        return static_cast<std::size_t>(fibonacciHash(hash)) & (mSlotCount - 1);
+    }
+
+    Slot* findSlot(std::uint64_t key) const
+    {
+        std::size_t index = getIndex(key);
+        for (std::size_t probes = 0; probes < mSlotCount; ++probes)
+        {
+            Slot& slot = mSlots[index];
+            const std::uint64_t slotKey = slot.key.load(std::memory_order_acquire);
+            if (slotKey == key)
+                return &slot;
+            if (slotKey == EmptyKey)
+                return nullptr;
+            index = (index + 1) & (mSlotCount - 1);
+        }
+        return nullptr;
+    }
+
+    // Returns the key's slot, claiming an empty one if the key has none yet.
+    Slot& claimSlot(std::uint64_t key)
+    {
+        if (key == EmptyKey)
+            throw ConcurrentHashmapException(ConcurrentHashmapException::ReservedKey);
+
+        std::size_t index = getIndex(key);
+        for (std::size_t probes = 0; probes < mSlotCount; ++probes)
+        {
+            Slot& slot = mSlots[index];
+            std::uint64_t slotKey = slot.key.load(std::memory_order_acquire);
+            if (slotKey == EmptyKey &&
+                slot.key.compare_exchange_strong(slotKey, key, std::memory_order_acq_rel, std::memory_order_acquire))
+            {
+                return slot;
+            }
+            // slotKey holds the winner's key if the CAS failed
+            if (slotKey == key)
+                return slot;
+            index = (index + 1) & (mSlotCount - 1);
+        }
+        throw ConcurrentHashmapException(ConcurrentHashmapException::TableFull);
+    }
+
+private:
+    const std::size_t mSlotCount; // power of two
+    const Hash mHasher;
+    std::atomic<std::size_t> mSize;
+    Slot* mSlots;
+};
+
+template<class Key, class Value, class Hash>
+const std::uint64_t ConcurrentFlatHashmap<Key, Value, Hash>::EmptyKey;
+
+template<class Key, class Value, class Hash>
+const std::uint64_t ConcurrentFlatHashmap<Key, Value, Hash>::AbsentValue;
+
+#endif
@@ -1,10 +1,22 @@
 #ifndef CONCURRENT_HASH_MAP_H
 #define CONCURRENT_HASH_MAP_H
 
+#include "LockPolicies.h"
+
 #include <algorithm>
 #include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
 #include <mutex>
+#include <new>
+#include <system_error>
+#include <thread>
+#include <type_traits>
 #include <utility>
+#include <vector>
 
 
 class ConcurrentHashmapException
@@ -14,7 +26,11 @@ public:
     {
         InvalidCapacity,
         InvalidConcurrencyLevel,
-        KeyNotFound
+        KeyNotFound,
+        PerfectHashConstructionFailed,
+        ReservedKey,
+        ReservedValue,
+        TableFull
     };
 
     explicit ConcurrentHashmapException(int code) : mCode(code) {}
@@ -29,40 +45,372 @@ private:
 };
 
 
-template<class Key, class Value, class Hash = std::hash<Key>>
+// Default number of stripe locks of the maps built on this header.
+const std::size_t ConcurrencyLevelDefault = 16;
+
+// Number of stripe locks for the given number of buckets: the concurrency level, at most one per bucket.
+// Throws ConcurrentHashmapException if either is 0.
+inline std::size_t getStripeCount(std::size_t capacity, std::size_t concurrencyLevel)
+{
+    if (capacity == 0)
+        throw ConcurrentHashmapException(ConcurrentHashmapException::InvalidCapacity);
+    if (concurrencyLevel == 0)
+        throw ConcurrentHashmapException(ConcurrentHashmapException::InvalidConcurrencyLevel);
+
+    return std::min(concurrencyLevel, capacity);
+}
+
+// splitmix64 finalizer: every bit of the result depends on every bit of hash, so both the low and the high
+// bits of weak hashes, such as the identity hashes std::hash gives integers, can be used.
+inline std::uint64_t mixHash(std::uint64_t hash)
+{
+    hash ^= hash >> 30;
+    hash *= 0xBF58476D1CE4E5B9ull;
+    hash ^= hash >> 27;
+    hash *= 0x94D049BB133111EBull;
+    hash ^= hash >> 31;
+    return hash;
+}
+
+// 2^64 divided by the golden ratio, the multiplier of Fibonacci hashing.
+const std::uint64_t FibonacciMultiplier = 0x9E3779B97F4A7C15ull;
+
+// Fibonacci hashing: the high half of the product spreads consecutive values over the whole 32-bit range.
+inline std::uint64_t fibonacciHash(std::uint64_t hash)
+{
+    return (hash * FibonacciMultiplier) >> 32;
+}
+
+
+// LockPolicy tag selecting one lock per bucket instead of lock striping.
+// The lock is the low bit of the bucket's head pointer, so it takes no extra memory
+// and threads contend only when their keys really fall into the same bucket.
+struct BucketBitLock {};
+
+
+// How bucket indices are assigned to lock stripes.
+enum class StripeMapping
+{
+    Contiguous,  // runs of adjacent buckets share a stripe
+    Interleaved, // bucket index modulo stripe count
+    Hashed       // high bits of a multiplicative hash of the bucket index
+};
+
+
+// MapPolicy parameter of ConcurrentHashmap, selects optional behaviours. The policies below derive from it
+// and override only their own field; derive from one of them to combine features, e.g.
+// struct VersionedSortedChainsPolicy : VersionedPolicy { static const bool SortedChains = true; };
+struct DefaultMapPolicy
+{
+    static const bool InsertOnly = false;
+    static const bool Versioned = false;
+    static const bool InlineFirstNode = false;
+    static const bool SortedChains = false;
+    static const bool Clearable = false;
+};
+
+// For maps that never erase, such as symbol and interning tables. find and getCopy traverse the bucket lists
+// with acquire loads and no locking; writers still serialize on the stripe locks. To keep that safe, nodes are
+// never modified or freed while the map is in use: overwriting a key links a new node in place of the old one,
+// which is kept until the map is destroyed. erase, combiningErase and get are disabled.
+struct InsertOnlyPolicy : DefaultMapPolicy
+{
+    static const bool InsertOnly = true;
+};
+
+// For read-mostly records updated with optimistic concurrency: every node carries a version that changes
+// on each write, getVersioned returns a copy with its version and compareAndSet writes only if the version
+// is unchanged. Callers compute new values without holding any lock, which is then only held for the
+// check and the store. Adds 8 bytes per node.
+struct VersionedPolicy : DefaultMapPolicy
+{
+    static const bool Versioned = true;
+};
+
+// For lookup-heavy maps at load factors up to about 1: every bucket has room for one node next to its head,
+// so the entry of a singleton chain is found without a second cache miss. A key takes its bucket's slot when
+// it's free and an overflow node from the heap otherwise; slots are freed with their nodes. The table grows
+// by the size of a node per bucket.
+struct InlineFirstNodePolicy : DefaultMapPolicy
+{
+    static const bool InlineFirstNode = true;
+};
+
+// For maps run at high load factors, or with many lookups of absent keys: every node stores its key's hash
+// and chains are kept in ascending hash order, so a lookup stops at the first larger hash instead of walking
+// the whole chain, and keys are only compared on equal hashes. Inserting finds the key's position in the same
+// pass that looks for the key. Adds 8 bytes per node.
+struct SortedChainsPolicy : DefaultMapPolicy
+{
+    static const bool SortedChains = true;
+};
+
+// For maps that are emptied as a whole from time to time, e.g. reset every second: enables clear, which
+// erases all keys in O(1). Every bucket records the generation of its nodes, which is checked whenever
+// the bucket is locked. Adds 8 bytes per bucket.
+struct ClearablePolicy : DefaultMapPolicy
+{
+    static const bool Clearable = true;
+};
+
+
+// Value of a ConcurrentHashmap node. Empty value types, such as the one of ConcurrentHashset,
+// are stored as a base class and take no space in the node.
+template<class Value, bool Empty = std::is_empty<Value>::value>
+class NodeValueStorage
+{
+public:
+    explicit NodeValueStorage(const Value& value) : mValue(value) {}
+
+    Value& value() { return mValue; }
+    const Value& value() const { return mValue; }
+
+private:
+    Value mValue;
+};
+
+template<class Value>
+class NodeValueStorage<Value, true> : private Value
+{
+public:
+    explicit NodeValueStorage(const Value& value) : Value(value) {}
+
+    Value& value() { return *this; }
+    const Value& value() const { return *this; }
+};
+
+
+// Version of a ConcurrentHashmap node, see VersionedPolicy. Takes no space in unversioned maps.
+template<bool Versioned>
+class NodeVersionStorage
+{
+public:
+    std::uint64_t version() const { return 0; }
+    void updateVersion() {}
+};
+
+// Versions are unique across all writes in the process, so a key that is erased and inserted again
+// never gets an old version back and a stale compareAndSet can't succeed.
+template<>
+class NodeVersionStorage<true>
+{
+public:
+    NodeVersionStorage() : mVersion(nextVersion()) {}
+
+    std::uint64_t version() const { return mVersion; }
+    void updateVersion() { mVersion = nextVersion(); }
+
+private:
+    static const std::uint64_t VersionBlockSize = 1024;
+
+    // Threads take blocks of versions from the global counter, so that writers don't all contend on it.
+    static std::uint64_t nextVersion()
+    {
+        static std::atomic<std::uint64_t> counter(1);
+        static thread_local std::uint64_t next = 0;
+        static thread_local std::uint64_t end = 0;
+        if (next == end)
+        {
+            next = counter.fetch_add(VersionBlockSize, std::memory_order_relaxed);
+            end = next + VersionBlockSize;
+        }
+        return next++;
+    }
+
+    std::uint64_t mVersion;
+};
+
+
+// Hash of the key of a ConcurrentHashmap node, see SortedChainsPolicy. Takes no space in unsorted maps,
+// whose chains order every node as if its hash were 0.
+template<bool Sorted>
+class NodeHashStorage
+{
+public:
+    std::size_t hash() const { return 0; }
+    void setHash(std::size_t) {}
+};
+
+template<>
+class NodeHashStorage<true>
+{
+public:
+    NodeHashStorage() : mHash(0) {}
+
+    std::size_t hash() const { return mHash; }
+    void setHash(std::size_t hash) { mHash = hash; }
+
+private:
+    std::size_t mHash;
+};
+
+
+// Generation of the nodes of a ConcurrentHashmap bucket, see ClearablePolicy. Takes no space in maps
+// that can't be cleared, whose buckets all stay in generation 0.
+template<bool Clearable>
+class BucketGenerationStorage
+{
+public:
+    std::uint64_t generation() const { return 0; }
+    void setGeneration(std::uint64_t) {}
+};
+
+// Guarded by the bucket lock.
+template<>
+class BucketGenerationStorage<true>
+{
+public:
+    BucketGenerationStorage() : mGeneration(0) {}
+
+    std::uint64_t generation() const { return mGeneration; }
+    void setGeneration(std::uint64_t generation) { mGeneration = generation; }
+
+private:
+    std::uint64_t mGeneration;
+};
+
+
+// Storage for one node inside a ConcurrentHashmap bucket, see InlineFirstNodePolicy. Empty without the policy.
+template<class Node, bool Inline>
+class InlineNodeSlot
+{
+public:
+    void* claimSlot() { return nullptr; }
+    bool holds(const Node*) const { return false; }
+    void releaseSlot() {}
+};
+
+// Claimed before the bucket lock is taken, so that the node is constructed outside the critical section,
+// and released once its node is destroyed, which may also happen after the lock is released.
+template<class Node>
+class InlineNodeSlot<Node, true>
+{
+public:
+    InlineNodeSlot() : mUsed(false) {}
+
+    // Returns the slot's storage, or nullptr if it holds a node already.
+    void* claimSlot()
+    {
+        if (mUsed.load(std::memory_order_relaxed) || mUsed.exchange(true, std::memory_order_acquire))
+            return nullptr;
+        return &mStorage;
+    }
+
+    bool holds(const Node* node) const
+    {
+        return static_cast<const void*>(node) == static_cast<const void*>(&mStorage);
+    }
+
+    void releaseSlot()
+    {
+        mUsed.store(false, std::memory_order_release);
+    }
+
+private:
+    typename std::aligned_storage<sizeof(Node), alignof(Node)>::type mStorage;
+    std::atomic<bool> mUsed;
+};
+
+
+// LockPolicy is the type of the stripe locks: std::mutex, one of the policies from LockPolicies.h or BucketBitLock.
+template<class Key, class Value, class Hash = std::hash<Key>, class LockPolicy = std::mutex, class MapPolicy = DefaultMapPolicy>
 class ConcurrentHashmap
 {
-    static const std::size_t ConcurrencyLevelDefault = 16;
+    static const std::size_t SplitShift = 2;
+    static const std::size_t SplitFactor = 1 << SplitShift;
+    static const std::size_t ContendedWeight = 8;
+    static const std::size_t CombiningPasses = 4;
+    static const std::size_t MoveBatchSize = 4096;
+    // The size word holds the size in its low SizeBits and the low bits of the generation it counts above.
+    // The size is signed within its bits, see size().
+    static const unsigned SizeBits = 40;
+    static const std::uint64_t SizeMask = (1ull << SizeBits) - 1;
+    static const std::uint64_t SizeSignBit = 1ull << (SizeBits - 1);
+    static const std::uint64_t GenerationTagMask = (1ull << (64 - SizeBits)) - 1;
 
-    struct Node
+    struct Node : NodeValueStorage<Value>, NodeVersionStorage<MapPolicy::Versioned>, NodeHashStorage<MapPolicy::SortedChains>
     {
+        Node(const Key& key, const Value& value, Node* next) : NodeValueStorage<Value>(value), key(key), next(next) {}
+
         const Key key;
-        Value value;
-        Node* next;
+        std::atomic<Node*> next; // atomic for the lock-free readers of InsertOnlyPolicy
     };
 
     class NodeList;
+    struct Stripe;
+    struct CombiningRequest;
+    struct PublicationList;
+    class SizeUpdate;
+    class RetiredNodes;
+    struct RetiredList;
+    struct ArenaHeader;
+    struct ArenaTable;
+
+    // Frees nodes through destroyNode, whichever storage they come from.
+    struct NodeDeleter
+    {
+        void operator()(Node* node) const
+        {
+            hashmap->destroyNode(node);
+        }
+
+        const ConcurrentHashmap* hashmap;
+    };
+    typedef std::unique_ptr<Node, NodeDeleter> NodePtr;
+
+    static const bool PerBucketLocks = std::is_same<LockPolicy, BucketBitLock>::value;
+
+    // Most bulkLoad arenas alive at once, and the room their header takes ahead of the nodes
+    static const std::size_t MaxArenas = 64;
+    static const std::size_t ArenaHeaderSize =
+        (sizeof(std::atomic<std::size_t>) + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+    typedef typename std::conditional<PerBucketLocks, NodeList, LockPolicy>::type BucketLock;
 
 public:
-    typedef std::pair<Value&, std::unique_lock<std::mutex>> LockedValue;
+    typedef std::pair<Value&, std::unique_lock<BucketLock>> LockedValue;
+    typedef std::pair<Value, std::uint64_t> VersionedValue;
+
+    class BulkWriter;
+    class NodeHandle;
+    class Transaction;
 
     explicit ConcurrentHashmap(
         std::size_t capacity, 
         std::size_t concurrencyLevel = ConcurrencyLevelDefault, 
-        const Hash& hasher = Hash()) : 
+        const Hash& hasher = Hash(),
+        StripeMapping stripeMapping = StripeMapping::Interleaved) : 
         mCapacity(capacity),
-        mMutexCount(getMutexCount(capacity, concurrencyLevel)),
+        mMutexCount(getStripeCount(capacity, concurrencyLevel)),
         mIndicesPerMutex(getIndicesPerMutex(mCapacity, mMutexCount)),
+        mStripeMapping(stripeMapping),
         mHasher(hasher),
         mSize(0),
+        mGeneration(0),
         mTable(new NodeList[capacity]),
-        mMutexes(new std::mutex[mMutexCount])
+        mStripes(PerBucketLocks ? nullptr : new Stripe[mMutexCount]),
+        mPublicationLists(new PublicationList[mMutexCount]),
+        mStripeCount(mMutexCount),
+        mSplitThreshold(0),
+        mArenas(nullptr),
+        mRetiredLists(MapPolicy::InsertOnly ? new RetiredList[mMutexCount] : nullptr)
     {
     }
 
     ~ConcurrentHashmap()
     {
-        delete[] mMutexes;
+        for (std::size_t i = 0; i < mCapacity; ++i)
+            destroyChain(mTable[i].release());
+        for (std::size_t i = 0; mRetiredLists && i < mMutexCount; ++i)
+        {
+            for (Node* node : mRetiredLists[i].nodes)
+                destroyNode(node);
+        }
+        delete[] mRetiredLists;
+        // the arenas went with their last nodes
+        delete mArenas.load(std::memory_order_relaxed);
+
+        delete[] mPublicationLists;
+        delete[] mStripes;
         delete[] mTable;
     }
 
@@ -72,30 +420,72 @@ public:
         return mCapacity;
     }
         
-    // Actual number of stored keys
+    // Actual number of stored keys. Batched inserts count their keys after releasing the locks, so keys
+    // erased concurrently may take the count below 0 for a moment, which reads as 0.
     std::size_t size() const
     {
-        return mSize;
+        const std::uint64_t count = mSize.load(std::memory_order_relaxed) & SizeMask;
+        return (count & SizeSignBit) ? 0 : static_cast<std::size_t>(count);
+    }
+
+    // Erases all keys in O(1): bumps the map's generation, which makes every bucket stale at once. The nodes
+    // of a stale bucket are detached by the next operation that locks the bucket, or by reclaim, and freed
+    // once the lock is released. Operations
+    // running concurrently take effect either before or after the clear, for all of their keys.
+    void clear()
+    {
+        static_assert(MapPolicy::Clearable, "clear needs ClearablePolicy");
+        static_assert(!MapPolicy::InsertOnly, "erase is disabled by InsertOnlyPolicy");
+
+        addToSize(mGeneration.fetch_add(1, std::memory_order_acq_rel) + 1, 0);
+    }
+
+    // Frees the nodes left in stale buckets by clear, e.g. from a background thread, visiting the buckets
+    // one at a time like forEach.
+    void reclaim()
+    {
+        static_assert(MapPolicy::Clearable, "reclaim needs ClearablePolicy");
+
+        std::unique_lock<BucketLock> lock;
+        for (std::size_t index = 0; index < mCapacity; ++index)
+            relockBucket(lock, index);
+    }
+
+    // Current number of stripe locks, grows as hot stripes are split. Not applicable to BucketBitLock.
+    std::size_t stripeCount() const
+    {
+        return mStripeCount;
+    }
+
+    // Enables splitting of hot stripes into SplitFactor finer-grained locks while the map is in use.
+    // Each contended acquisition adds ContendedWeight to the stripe's score and each uncontended one takes 1 away,
+    // the stripe is split when the score reaches the threshold, i.e. when roughly more than one acquisition
+    // in ContendedWeight + 1 keeps finding it locked. Splits are never undone. 0 disables splitting (the default).
+    void setStripeSplitThreshold(std::size_t threshold)
+    {
+        mSplitThreshold.store(threshold, std::memory_order_relaxed);
     }
 
     // In multithreaded environment true result does not guarantee that key still exists in the map after return from find.
     bool find(const Key& key) const
     {
-        const std::size_t index = getIndex(key);
-        std::lock_guard<std::mutex> lock(getMutex(index));
+        const std::size_t hash = mHasher(key);
+        const std::size_t index = getIndexOfHash(hash);
+        std::unique_lock<BucketLock> lock(lockBucketForReading(index));
 
-        return mTable[index].find(key) != nullptr;
+        return mTable[index].find(key, hash) != nullptr;
     }
 
     // Returns copy of value stored in the map or throws ConcurrentHashmapException if the key is not found.
     // In multithreaded environment it's not guaranteed that key still exists in the map after return from getCopy.
     Value getCopy(const Key& key) const
     {
-        const std::size_t index = getIndex(key);
-        std::lock_guard<std::mutex> lock(getMutex(index));
+        const std::size_t hash = mHasher(key);
+        const std::size_t index = getIndexOfHash(hash);
+        std::unique_lock<BucketLock> lock(lockBucketForReading(index));
 
-        if (const Node* node = mTable[index].find(key))
-            return node->value;
+        if (const Node* node = mTable[index].find(key, hash))
+            return node->value();
         else
             throw ConcurrentHashmapException(ConcurrentHashmapException::KeyNotFound);
 
@@ -103,158 +493,1831 @@ public:
 
     // Returns a reference to the value stored in the map paired with the lock.
     // The value is garanteed to exist in the map as long as the lock is locked.
+    // Not available with InsertOnlyPolicy, whose readers would race with writes through the reference.
     LockedValue get(const Key& key) const
     {
-        const std::size_t index = getIndex(key);
-        std::unique_lock<std::mutex> lock(getMutex(index));
+        static_assert(!MapPolicy::InsertOnly, "get is disabled by InsertOnlyPolicy, use getCopy");
 
-        if (Node* node = mTable[index].find(key))
-            return LockedValue(node->value, std::move(lock));
+        const std::size_t hash = mHasher(key);
+        const std::size_t index = getIndexOfHash(hash);
+        std::unique_lock<BucketLock> lock(lockBucket(index));
+
+        if (Node* node = mTable[index].find(key, hash))
+        {
+            // the caller may write through the reference
+            node->updateVersion();
+            return LockedValue(node->value(), std::move(lock));
+        }
         else
             throw ConcurrentHashmapException(ConcurrentHashmapException::KeyNotFound);
     }
 
     // Inserts new key-value into the map or overwrires the old value if the key already existed.
-    void insert(const Key& key, const Value& value)
+    // Returns true if the key is new. An existing value is assigned in place; a new key's node is built
+    // under the lock, which keeps the chains in allocation order and costs no second lookup.
+    // With InsertOnlyPolicy the old node is replaced instead and retired after releasing the lock.
+    bool insert(const Key& key, const Value& value)
     {
-        const std::size_t index = getIndex(key);
-        std::lock_guard<std::mutex> lock(getMutex(index));
+        const std::size_t hash = mHasher(key);
+        const std::size_t index = getIndexOfHash(hash);
+        std::unique_lock<BucketLock> lock(lockBucket(index));
+
+        if (!MapPolicy::InsertOnly)
+        {
+            if (Node* existing = mTable[index].find(key, hash))
+            {
+                existing->value() = value;
+                existing->updateVersion();
+                return false;
+            }
+            mTable[index].link(createNode(index, hash, key, value));
+            updateSize(index, 1);
+            return true;
+        }
 
-        if (mTable[index].insert(key, value))
-            ++mSize;
+        Node* replaced;
+        if (linkLocked(index, createNode(index, hash, key, value), replaced))
+        {
+            updateSize(index, 1);
+            return true;
+        }
+        lock.unlock();
+        if (replaced)
+            retireNode(replaced);
+        return false;
     }
 
-    // Deletes key from the map or does nothing if key is not found
-    void erase(const Key& key)
+    // Deletes key from the map or does nothing if key is not found. Returns true if the key was deleted.
+    bool erase(const Key& key)
     {
-        const std::size_t index = getIndex(key);
-        std::lock_guard<std::mutex> lock(getMutex(index));
+        static_assert(!MapPolicy::InsertOnly, "erase is disabled by InsertOnlyPolicy");
 
-        if (mTable[index].erase(key))
-            --mSize;
+        const std::size_t hash = mHasher(key);
+        const std::size_t index = getIndexOfHash(hash);
+        std::unique_lock<BucketLock> lock(lockBucket(index));
+
+        Node* node = mTable[index].unlink(key, hash);
+        if (!node)
+            return false;
+        updateSize(index, -1);
+        lock.unlock();
+        destroyNode(node);
+        return true;
     }
 
-private:
-    // noncopyable
-    ConcurrentHashmap(const ConcurrentHashmap&) = delete;
-    ConcurrentHashmap& operator=(const ConcurrentHashmap&) = delete;
+    // Unlinks the key's node and hands it over, or returns an empty handle if key not found.
+    // The node isn't copied, unless it was carved out of a bulkLoad arena or sat in an inline bucket slot;
+    // such nodes are copied after the bucket lock is released.
+    NodeHandle extract(const Key& key)
+    {
+        static_assert(!MapPolicy::InsertOnly, "erase is disabled by InsertOnlyPolicy");
 
-    std::size_t getMutexCount(std::size_t capacity, std::size_t concurrencyLevel) const
+        const std::size_t hash = mHasher(key);
+        const std::size_t index = getIndexOfHash(hash);
+        Node* node;
+        {
+            std::unique_lock<BucketLock> lock(lockBucket(index));
+            node = mTable[index].unlink(key, hash);
+            if (!node)
+                return NodeHandle();
+            updateSize(index, -1);
+        }
+
+        // embedded nodes are copied once the lock is released
+        if (isEmbeddedNode(node))
+        {
+            Node* copy;
+            try
+            {
+                copy = copyNode(node);
+            }
+            catch (...)
+            {
+                restoreNode(node);
+                throw;
+            }
+            destroyNode(node);
+            node = copy;
+        }
+        return NodeHandle(node);
+    }
+
+    // Links the node of the handle, which is left empty, overwriting the value if the key exists.
+    // Returns true if the key is new, false also for an empty handle.
+    bool insert(NodeHandle&& handle)
     {
-        if (capacity == 0)
-            throw ConcurrentHashmapException(ConcurrentHashmapException::InvalidCapacity);
-        if (concurrencyLevel == 0)
-            throw ConcurrentHashmapException(ConcurrentHashmapException::InvalidConcurrencyLevel);
+        if (handle.empty())
+            return false;
 
-        return std::min(concurrencyLevel, capacity);
+        const std::size_t hash = mHasher(handle.key());
+        const std::size_t index = getIndexOfHash(hash);
+        std::unique_lock<BucketLock> lock(lockBucket(index));
+
+        Node* const node = handle.release();
+        node->setHash(hash);
+        node->updateVersion();
+        Node* replaced;
+        if (linkLocked(index, node, replaced))
+        {
+            updateSize(index, 1);
+            return true;
+        }
+        lock.unlock();
+        if (replaced)
+            retireNode(replaced);
+        return false;
     }
-    
-    std::size_t getIndicesPerMutex(std::size_t capacity, std::size_t mutexCount) const
+
+    // Moves the entries for which pred(const Key&, const Value&) returns true to target, relinking their nodes.
+    // Buckets are scanned in order like forEach; the matching nodes are unlinked under the bucket locks and
+    // linked into target in batches, grouped by target stripe. Meanwhile the moved keys are in neither map.
+    // Returns the number of moved entries.
+    template<class Predicate>
+    std::size_t moveAll(Predicate pred, ConcurrentHashmap& target)
     {
-        if (capacity % mutexCount)
-            return (capacity + mutexCount) / mutexCount; // ceil(capacity / mutexCount)
-        else
-            return capacity / mutexCount;
+        static_assert(!MapPolicy::InsertOnly, "erase is disabled by InsertOnlyPolicy");
+
+        if (&target == this)
+            return 0;
+
+        std::size_t moved = 0;
+        std::vector<Node*> nodes;
+        try
+        {
+            std::size_t index = 0;
+            while (index < mCapacity)
+            {
+                {
+                    std::unique_lock<BucketLock> lock;
+                    for (; index < mCapacity && nodes.size() < MoveBatchSize; ++index)
+                    {
+                        relockBucket(lock, index);
+                        unlinkIfLocked(index, pred, nodes);
+                    }
+                }
+                copyEmbeddedNodes(nodes);
+                moved += nodes.size();
+                target.linkNodes(nodes);
+            }
+        }
+        catch (...)
+        {
+            // the batch that didn't make it to target goes back
+            restoreNodes(nodes);
+            throw;
+        }
+        return moved;
     }
 
-    std::size_t getIndex(const Key& key) const
+    // Calls fn(const Value&) on the key's value in place, under the bucket lock. Returns false if key not found.
+    template<class Function>
+    bool visit(const Key& key, Function fn) const
     {
-        return mHasher(key) % mCapacity;
+        const std::size_t hash = mHasher(key);
+        const std::size_t index = getIndexOfHash(hash);
+        std::unique_lock<BucketLock> lock(lockBucketForReading(index));
+
+        const Node* node = mTable[index].find(key, hash);
+        if (!node)
+            return false;
+        fn(node->value());
+        return true;
     }
 
-    std::mutex& getMutex(std::size_t tableIndex) const
+    // Calls fn(Value&) on the key's value in place, under the bucket lock, inserting a default constructed
+    // value first if the key is missing. Returns true if the key was inserted.
+    template<class Function>
+    bool upsert(const Key& key, Function fn)
     {
-        const std::size_t mutexIndex = tableIndex / mIndicesPerMutex;
-        return mMutexes[mutexIndex];
+        static_assert(!MapPolicy::InsertOnly, "in-place updates are disabled by InsertOnlyPolicy");
+
+        const std::size_t hash = mHasher(key);
+        const std::size_t index = getIndexOfHash(hash);
+        {
+            std::unique_lock<BucketLock> lock(lockBucket(index));
+            if (Node* node = mTable[index].find(key, hash))
+            {
+                fn(node->value());
+                node->updateVersion();
+                return false;
+            }
+        }
+
+        // a missing key's node is built without the lock, so the key is looked up again once it's taken;
+        // declared first, the node is destroyed after the lock is released if it isn't needed
+        NodePtr node(createNode(index, hash, key, Value()), NodeDeleter{ this });
+        std::unique_lock<BucketLock> lock(lockBucket(index));
+        if (Node* existing = mTable[index].find(key, hash))
+        {
+            fn(existing->value());
+            existing->updateVersion();
+            return false;
+        }
+
+        fn(node->value());
+        mTable[index].link(node.release());
+        updateSize(index, 1);
+        return true;
     }
 
-private:
-    const std::size_t mCapacity;
-    const std::size_t mMutexCount;
-    const std::size_t mIndicesPerMutex;
-    const Hash mHasher;
-    std::atomic<std::size_t> mSize;
-    NodeList* mTable;
-    std::mutex* mMutexes;
-};
+    // Calls pred(Value&) on the key's value under the bucket lock and erases the key if it returns true.
+    // pred may modify the value it keeps. Returns true if the key was erased.
+    template<class Predicate>
+    bool eraseIf(const Key& key, Predicate pred)
+    {
+        static_assert(!MapPolicy::InsertOnly, "erase is disabled by InsertOnlyPolicy");
 
-template<class Key, class Value, class Hash>
-class ConcurrentHashmap<Key, Value, Hash>::NodeList
-{
-public:
-    NodeList() : mHead(nullptr) {}
-    ~NodeList()
+        const std::size_t hash = mHasher(key);
+        const std::size_t index = getIndexOfHash(hash);
+        std::unique_lock<BucketLock> lock(lockBucket(index));
+
+        Node* node = mTable[index].find(key, hash);
+        if (!node)
+            return false;
+        if (!pred(node->value()))
+        {
+            node->updateVersion();
+            return false;
+        }
+
+        mTable[index].unlink(key, hash);
+        updateSize(index, -1);
+        lock.unlock();
+        destroyNode(node);
+        return true;
+    }
+
+    // Returns a copy of the value with its version, or throws ConcurrentHashmapException if the key is not found.
+    VersionedValue getVersioned(const Key& key) const
     {
-        while (mHead)
-            deleteHead();
+        static_assert(MapPolicy::Versioned, "getVersioned needs VersionedPolicy");
+
+        const std::size_t hash = mHasher(key);
+        const std::size_t index = getIndexOfHash(hash);
+        std::unique_lock<BucketLock> lock(lockBucketForReading(index));
+
+        if (const Node* node = mTable[index].find(key, hash))
+            return VersionedValue(node->value(), node->version());
+        throw ConcurrentHashmapException(ConcurrentHashmapException::KeyNotFound);
     }
 
-    Node* find(const Key& key) const
+    // Stores newValue if the key's version is still expectedVersion, as returned by getVersioned.
+    // Returns false if the key has been written or erased since. The value is moved in under the lock.
+    bool compareAndSet(const Key& key, std::uint64_t expectedVersion, Value newValue)
     {
-        Node* node = mHead;
-        while (node && node->key != key)
-            node = node->next;
+        static_assert(MapPolicy::Versioned, "compareAndSet needs VersionedPolicy");
+        static_assert(!MapPolicy::InsertOnly, "in-place updates are disabled by InsertOnlyPolicy");
 
-        return node;
+        const std::size_t hash = mHasher(key);
+        const std::size_t index = getIndexOfHash(hash);
+        std::unique_lock<BucketLock> lock(lockBucket(index));
+
+        Node* node = mTable[index].find(key, hash);
+        if (!node || node->version() != expectedVersion)
+            return false;
+        node->value() = std::move(newValue);
+        node->updateVersion();
+        return true;
     }
 
-    // Returns true if inserted, false if key already existed and value was overwirtten.
-    bool insert(const Key& key, const Value& value)
+    // Batched find: writes find(key) for every key of [first, last) to results, in input order.
+    // The lookups are grouped by stripe, so each stripe lock is taken about once per batch.
+    template<class ForwardIt, class OutputIt>
+    void findAll(ForwardIt first, ForwardIt last, OutputIt results) const
     {
-        if (Node* node = find(key))
+        std::vector<std::pair<std::size_t, std::size_t>> lookups; // (table index, input position)
+        std::vector<std::size_t> hashes;
+        std::vector<const Key*> keys;
+        for (ForwardIt it = first; it != last; ++it)
         {
-            node->value = value;
-            return false;
+            hashes.push_back(mHasher(*it));
+            lookups.push_back(std::make_pair(getIndexOfHash(hashes.back()), keys.size()));
+            keys.push_back(&*it);
         }
+        std::sort(lookups.begin(), lookups.end(),
+            [this](const std::pair<std::size_t, std::size_t>& a, const std::pair<std::size_t, std::size_t>& b)
+            {
+                return getMutexIndex(a.first) < getMutexIndex(b.first);
+            });
 
-        Node* newNode = new Node{ key, value, mHead };
-        mHead = newNode;
-        return true;
+        std::vector<char> found(keys.size());
+        {
+            std::unique_lock<BucketLock> lock;
+            for (const std::pair<std::size_t, std::size_t>& lookup : lookups)
+            {
+                if (!MapPolicy::InsertOnly)
+                    relockBucket(lock, lookup.first);
+                found[lookup.second] = mTable[lookup.first].find(*keys[lookup.second], hashes[lookup.second]) != nullptr;
+            }
+        }
+        for (char isFound : found)
+            *results++ = isFound != 0;
     }
 
-    // Returns true if deleted, false if key not found.
-    bool erase(const Key& key)
+    // Runs fn(Transaction&) atomically over the given keys: the locks of all their buckets are held while fn
+    // reads and writes the keys through the Transaction, keys being referred to by their position in keys.
+    // Locks are taken in ascending address order, so overlapping transactions can't deadlock; each lock is
+    // taken once however many of the keys it covers. Returns what fn returns.
+    // Unlike the other writes, a transaction builds the nodes of new keys under its locks, since their values
+    // are only known inside fn; erased nodes are still destroyed after the locks are released.
+    template<class Function>
+    auto transact(const std::vector<Key>& keys, Function fn) -> decltype(fn(std::declval<Transaction&>()))
     {
-        if (!mHead)
-            return false;
+        static_assert(!MapPolicy::InsertOnly, "transactions are disabled by InsertOnlyPolicy");
 
-        if (mHead->key == key)
+        std::vector<std::size_t> hashes;
+        std::vector<std::size_t> indices;
+        hashes.reserve(keys.size());
+        indices.reserve(keys.size());
+        for (const Key& key : keys)
         {
-            deleteHead();
-            return true;
+            hashes.push_back(mHasher(key));
+            indices.push_back(getIndexOfHash(hashes.back()));
         }
 
-        Node* prev = mHead;
-        Node* node = mHead->next;
-        while (node && node->key != key)
+        // declared first so that the nodes it erases are destroyed after the locks are released
+        Transaction transaction(*this, keys, hashes, indices);
+        std::vector<std::unique_lock<BucketLock>> locks;
+        while (!lockBuckets(indices, locks))
         {
-            prev = node;
-            node = node->next;
         }
+        return fn(transaction);
+    }
 
-        if (node)
+    // Flat-combining variants of insert and erase for write-heavy hot stripes. The operation is published
+    // in the stripe's publication list; one of the waiting threads becomes the combiner and executes
+    // all pending operations of the stripe in one pass, so the stripe's buckets stay in one core's cache
+    // and the lock isn't handed over between threads for every write.
+    void combiningInsert(const Key& key, const Value& value)
+    {
+        const std::size_t hash = mHasher(key);
+        const std::size_t index = getIndexOfHash(hash);
+        NodePtr node(createNode(index, hash, key, value), NodeDeleter{ this });
+        CombiningRequest request(index, hash, key, node.release());
+        combine(request);
+    }
+
+    void combiningErase(const Key& key)
+    {
+        static_assert(!MapPolicy::InsertOnly, "erase is disabled by InsertOnlyPolicy");
+
+        const std::size_t hash = mHasher(key);
+        CombiningRequest request(getIndexOfHash(hash), hash, key, nullptr);
+        combine(request);
+    }
+
+    // Inserts the key-value pairs of [first, last) using the given number of threads: keys are hashed
+    // and radix-partitioned by stripe in parallel, then every stripe's entries are linked by a single owner
+    // thread that takes the stripe lock once. Nodes are carved out of one contiguous arena, which is freed
+    // once its last node is destroyed; beyond MaxArenas live arenas, nodes are allocated one by one.
+    // Later duplicates overwrite earlier ones, as with sequential inserts.
+    // The map may be used concurrently; the loaded keys become visible stripe by stripe.
+    template<class RandomIt>
+    void bulkLoad(RandomIt first, RandomIt last, std::size_t threads = std::thread::hardware_concurrency())
+    {
+        const std::size_t count = static_cast<std::size_t>(last - first);
+        if (count == 0)
+            return;
+        threads = std::max<std::size_t>(1, std::min(threads, count));
+
+        // hash and count entries per stripe
+        std::vector<std::size_t> indices(count);
+        std::vector<std::vector<std::size_t>> stripeCounts(threads, std::vector<std::size_t>(mMutexCount));
+        parallelFor(threads, [&](std::size_t thread)
         {
-            prev->next = node->next;
-            delete node;
-            return true;
+            std::vector<std::size_t>& counts = stripeCounts[thread];
+            for (std::size_t i = count * thread / threads; i < count * (thread + 1) / threads; ++i)
+            {
+                indices[i] = getIndex(first[i].first);
+                ++counts[getMutexIndex(indices[i])];
+            }
+        });
+
+        // exclusive prefix sums in (stripe, thread) order keep the partition stable
+        std::vector<std::size_t> stripeBegins(mMutexCount + 1);
+        std::size_t offset = 0;
+        for (std::size_t stripe = 0; stripe < mMutexCount; ++stripe)
+        {
+            stripeBegins[stripe] = offset;
+            for (std::size_t thread = 0; thread < threads; ++thread)
+            {
+                const std::size_t stripeCount = stripeCounts[thread][stripe];
+                stripeCounts[thread][stripe] = offset;
+                offset += stripeCount;
+            }
         }
-        return false;
+        stripeBegins[mMutexCount] = offset;
+
+        std::vector<std::size_t> order(count);
+        parallelFor(threads, [&](std::size_t thread)
+        {
+            std::vector<std::size_t>& offsets = stripeCounts[thread];
+            for (std::size_t i = count * thread / threads; i < count * (thread + 1) / threads; ++i)
+                order[offsets[getMutexIndex(indices[i])]++] = i;
+        });
+
+        // the arena starts out counting all its nodes as live, the ones never built are subtracted at the end
+        ArenaHeader* const arena = allocateArena(count);
+        Node* const nodes = arena ? arenaNodes(arena) : nullptr;
+        std::atomic<std::size_t> built(0);
+        std::atomic<std::size_t> nextStripe(0);
+        try
+        {
+            parallelFor(threads, [&](std::size_t)
+            {
+                std::size_t stripe;
+                while ((stripe = nextStripe.fetch_add(1, std::memory_order_relaxed)) < mMutexCount)
+                {
+                    SizeUpdate sizeUpdate(*this);
+                    RetiredNodes retired(*this);
+                    retired.reserve(stripeBegins[stripe + 1] - stripeBegins[stripe]);
+                    std::unique_lock<BucketLock> lock;
+                    std::size_t position = stripeBegins[stripe];
+                    try
+                    {
+                        for (; position < stripeBegins[stripe + 1]; ++position)
+                        {
+                            const std::size_t i = order[position];
+                            const std::size_t index = indices[i];
+                            Node* const node = nodes
+                                ? new (nodes + position) Node(first[i].first, first[i].second, nullptr)
+                                : new Node(first[i].first, first[i].second, nullptr);
+                            node->setHash(chainHash(first[i].first));
+                            relockBucket(lock, index);
+                            Node* replaced;
+                            if (linkLocked(index, node, replaced))
+                                sizeUpdate.add(index, 1);
+                            else
+                                retired.add(replaced);
+                        }
+                    }
+                    catch (...)
+                    {
+                        built.fetch_add(position - stripeBegins[stripe], std::memory_order_relaxed);
+                        throw;
+                    }
+                    built.fetch_add(position - stripeBegins[stripe], std::memory_order_relaxed);
+                }
+            });
+        }
+        catch (...)
+        {
+            if (arena)
+                releaseArenaNodes(arena, count - built.load(std::memory_order_relaxed));
+            throw;
+        }
+        if (arena)
+            releaseArenaNodes(arena, count - built.load(std::memory_order_relaxed));
     }
 
-private:
+    // Calls fn(key, value) for every entry while holding the entry's bucket lock. Buckets are visited one
+    // at a time, so entries inserted or erased concurrently may or may not be seen.
+    template<class Function>
+    void forEach(Function fn) const
+    {
+        std::unique_lock<BucketLock> lock;
+        for (std::size_t index = 0; index < mCapacity; ++index)
+        {
+            relockBucket(lock, index);
+            mTable[index].forEach(fn);
+        }
+    }
+
+    // Copy of the hash function the map was built with
+    Hash hashFunction() const
+    {
+        return mHasher;
+    }
+
+private:
+    // noncopyable
+    ConcurrentHashmap(const ConcurrentHashmap&) = delete;
+    ConcurrentHashmap& operator=(const ConcurrentHashmap&) = delete;
+
+    std::size_t getIndicesPerMutex(std::size_t capacity, std::size_t mutexCount) const
+    {
+        if (capacity % mutexCount)
+            return (capacity + mutexCount) / mutexCount; // ceil(capacity / mutexCount)
+        else
+            return capacity / mutexCount;
+    }
+
+    std::size_t getIndex(const Key& key) const
+    {
+        return getIndexOfHash(mHasher(key));
+    }
+
+    std::size_t getIndexOfHash(std::size_t hash) const
+    {
+        return hash % mCapacity;
+    }
+
+    // Hash a node of the key stores, see SortedChainsPolicy. Skips hashing the key in unsorted maps.
+    std::size_t chainHash(const Key& key) const
+    {
+        return MapPolicy::SortedChains ? mHasher(key) : 0;
+    }
+
+    std::size_t getMutexIndex(std::size_t tableIndex) const
+    {
+        switch (mStripeMapping)
+        {
+        case StripeMapping::Contiguous:
+            return tableIndex / mIndicesPerMutex;
+        case StripeMapping::Hashed:
+            // Must stay a function of the bucket index alone: all keys of a bucket need the same stripe.
+            return static_cast<std::size_t>(fibonacciHash(tableIndex)) % mMutexCount;
+        default:
+            return tableIndex % mMutexCount;
+        }
+    }
+
+    // Remaining bucket index bits that select a sub-stripe once the stripe is split
+    std::size_t getSubStripeKey(std::size_t tableIndex) const
+    {
+        switch (mStripeMapping)
+        {
+        case StripeMapping::Contiguous:
+            return tableIndex % mIndicesPerMutex;
+        case StripeMapping::Hashed:
+            return tableIndex;
+        default:
+            return tableIndex / mMutexCount;
+        }
+    }
+
+    // Lock currently protecting the bucket. Stable only while the caller holds it.
+    BucketLock& getMutex(std::size_t tableIndex) const
+    {
+        return getMutex(tableIndex, std::integral_constant<bool, PerBucketLocks>());
+    }
+
+    NodeList& getMutex(std::size_t tableIndex, std::true_type) const
+    {
+        return mTable[tableIndex];
+    }
+
+    LockPolicy& getMutex(std::size_t tableIndex, std::false_type) const
+    {
+        Stripe* stripe = &mStripes[getMutexIndex(tableIndex)];
+        std::size_t subStripeKey = getSubStripeKey(tableIndex);
+        while (Stripe* children = stripe->children.load(std::memory_order_acquire))
+        {
+            stripe = &children[subStripeKey % SplitFactor];
+            subStripeKey /= SplitFactor;
+        }
+        return stripe->lock;
+    }
+
+    // Makes lock hold the lock of the given bucket, keeping it if it's already the right one.
+    // Lets batch operations take a lock once for a run of buckets sharing it.
+    void relockBucket(std::unique_lock<BucketLock>& lock, std::size_t tableIndex) const
+    {
+        if (lock.owns_lock())
+        {
+            Node* stale = nullptr;
+            if (lock.mutex() == &getMutex(tableIndex) && !(stale = detachStaleLocked(tableIndex)))
+                return;
+            lock.unlock();
+            destroyChain(stale);
+        }
+        lock = lockBucket(tableIndex);
+    }
+
+    // Locks every distinct lock of the buckets, in ascending address order. Returns false, holding nothing,
+    // if a stripe was split before its lock was taken, moving some of the buckets to locks not taken.
+    // Stale buckets are emptied first: their nodes are destroyed with the locks released and false is returned.
+    bool lockBuckets(const std::vector<std::size_t>& indices, std::vector<std::unique_lock<BucketLock>>& locks) const
+    {
+        std::vector<Node*> staleChains;
+        staleChains.reserve(MapPolicy::Clearable ? indices.size() : 0);
+        std::vector<BucketLock*> mutexes;
+        mutexes.reserve(indices.size());
+        for (std::size_t index : indices)
+            mutexes.push_back(&getMutex(index));
+        std::sort(mutexes.begin(), mutexes.end(), std::less<BucketLock*>());
+        mutexes.erase(std::unique(mutexes.begin(), mutexes.end()), mutexes.end());
+
+        locks.clear();
+        for (BucketLock* mutex : mutexes)
+            locks.push_back(std::unique_lock<BucketLock>(*mutex));
+
+        // children are published under the parent lock, so the buckets' locks can't change anymore
+        for (std::size_t index : indices)
+        {
+            if (!std::binary_search(mutexes.begin(), mutexes.end(), &getMutex(index), std::less<BucketLock*>()))
+            {
+                locks.clear();
+                return false;
+            }
+        }
+        for (std::size_t index : indices)
+        {
+            if (Node* stale = detachStaleLocked(index))
+                staleChains.push_back(stale);
+        }
+        if (staleChains.empty())
+            return true;
+
+        locks.clear();
+        for (Node* stale : staleChains)
+            destroyChain(stale);
+        return false;
+    }
+
+    // Moves the bucket's nodes for which pred(key, value) returns true to nodes. The bucket's lock must be held.
+    template<class Predicate>
+    void unlinkIfLocked(std::size_t tableIndex, Predicate& pred, std::vector<Node*>& nodes)
+    {
+        const std::size_t begin = nodes.size();
+        try
+        {
+            mTable[tableIndex].unlinkIf(pred, nodes);
+        }
+        catch (...)
+        {
+            updateSize(tableIndex, -static_cast<std::ptrdiff_t>(nodes.size() - begin));
+            throw;
+        }
+        updateSize(tableIndex, -static_cast<std::ptrdiff_t>(nodes.size() - begin));
+    }
+
+    // Replaces the embedded nodes among the unlinked nodes by heap copies, which another map can free, and
+    // destroys the originals. Called without locks. If a copy fails, nodes holds both copies and originals.
+    void copyEmbeddedNodes(std::vector<Node*>& nodes) const
+    {
+        for (Node*& node : nodes)
+        {
+            if (isEmbeddedNode(node))
+            {
+                Node* const copy = copyNode(node);
+                destroyNode(node);
+                node = copy;
+            }
+        }
+    }
+
+    // Links a node unlinked by a failed operation back into its bucket, or destroys it if its key has been
+    // inserted again meanwhile.
+    void restoreNode(Node* node)
+    {
+        const std::size_t hash = mHasher(node->key);
+        const std::size_t index = getIndexOfHash(hash);
+        std::unique_lock<BucketLock> lock(lockBucket(index));
+        if (mTable[index].find(node->key, hash))
+        {
+            lock.unlock();
+            destroyNode(node);
+            return;
+        }
+        mTable[index].link(node);
+        updateSize(index, 1);
+    }
+
+    // nodes is left empty.
+    void restoreNodes(std::vector<Node*>& nodes)
+    {
+        for (Node* node : nodes)
+            restoreNode(node);
+        nodes.clear();
+    }
+
+    // Links the nodes, taking ownership of them, grouped by stripe so that each lock is taken about once.
+    // nodes is left empty.
+    void linkNodes(std::vector<Node*>& nodes)
+    {
+        // counting sort by stripe, stable so that runs of nodes of the same bucket stay together
+        std::vector<std::size_t> indices(nodes.size());
+        std::vector<std::size_t> stripeOffsets(mMutexCount + 1);
+        for (std::size_t i = 0; i < nodes.size(); ++i)
+        {
+            const std::size_t hash = mHasher(nodes[i]->key);
+            nodes[i]->setHash(hash);
+            indices[i] = getIndexOfHash(hash);
+            ++stripeOffsets[getMutexIndex(indices[i]) + 1];
+        }
+        for (std::size_t stripe = 0; stripe < mMutexCount; ++stripe)
+            stripeOffsets[stripe + 1] += stripeOffsets[stripe];
+
+        std::vector<std::pair<std::size_t, Node*>> entries(nodes.size()); // (table index, node)
+        for (std::size_t i = 0; i < nodes.size(); ++i)
+            entries[stripeOffsets[getMutexIndex(indices[i])]++] = std::make_pair(indices[i], nodes[i]);
+        nodes.clear();
+
+        SizeUpdate sizeUpdate(*this);
+        RetiredNodes retired(*this);
+        retired.reserve(entries.size());
+        std::size_t linked = 0;
+        try
+        {
+            std::unique_lock<BucketLock> lock;
+            for (; linked < entries.size(); ++linked)
+            {
+                entries[linked].second->updateVersion();
+                relockBucket(lock, entries[linked].first);
+                Node* replaced;
+                if (linkLocked(entries[linked].first, entries[linked].second, replaced))
+                    sizeUpdate.add(entries[linked].first, 1);
+                else
+                    retired.add(replaced);
+            }
+        }
+        catch (...)
+        {
+            for (; linked < entries.size(); ++linked)
+                destroyNode(entries[linked].second);
+            throw;
+        }
+    }
+
+    // Readers of insert-only maps don't lock, see InsertOnlyPolicy.
+    std::unique_lock<BucketLock> lockBucketForReading(std::size_t tableIndex) const
+    {
+        if (MapPolicy::InsertOnly)
+            return std::unique_lock<BucketLock>();
+        return lockBucket(tableIndex);
+    }
+
+    // Links the node into the bucket, whose lock must be held, in place of the node with the same key if any.
+    // The replaced node is handed back to be retired once the lock is released, or nullptr.
+    // Returns true if the key is new.
+    bool linkLocked(std::size_t tableIndex, Node* node, Node*& replaced)
+    {
+        replaced = mTable[tableIndex].replace(node);
+        return !replaced;
+    }
+
+    // Disposes of a node unlinked under a lock that has been released since. Lock-free readers of
+    // InsertOnlyPolicy may still traverse it, so there it's kept until the map is destroyed, in one of
+    // mMutexCount lists picked by the node's address to spread the writers.
+    void retireNode(Node* node) const
+    {
+        if (!MapPolicy::InsertOnly)
+        {
+            destroyNode(node);
+            return;
+        }
+
+        RetiredList& list = mRetiredLists[mixHash(reinterpret_cast<std::uintptr_t>(node)) % mMutexCount];
+        std::lock_guard<std::mutex> lock(list.mutex);
+        list.nodes.push_back(node);
+    }
+
+    // Returns the locked lock protecting the given bucket, whose nodes are current. The nodes of a stale
+    // bucket are destroyed with the lock released, then the lock is taken again.
+    std::unique_lock<BucketLock> lockBucket(std::size_t tableIndex) const
+    {
+        while (true)
+        {
+            std::unique_lock<BucketLock> lock(lockBucket(tableIndex, std::integral_constant<bool, PerBucketLocks>()));
+            Node* const stale = detachStaleLocked(tableIndex);
+            if (!stale)
+                return lock;
+            lock.unlock();
+            destroyChain(stale);
+        }
+    }
+
+    // Empties the bucket if the map has been cleared since the bucket was last locked and returns its former
+    // nodes, which the caller destroys once the lock is released. Every locking path calls it with the bucket's
+    // lock held, so buckets only ever hold nodes of one generation.
+    Node* detachStaleLocked(std::size_t tableIndex) const
+    {
+        if (!MapPolicy::Clearable)
+            return nullptr;
+
+        const std::uint64_t generation = mGeneration.load(std::memory_order_acquire);
+        NodeList& bucket = mTable[tableIndex];
+        if (bucket.generation() == generation)
+            return nullptr;
+
+        bucket.setGeneration(generation);
+        return bucket.release();
+    }
+
+    // Frees a list of nodes that are no longer linked into any bucket.
+    void destroyChain(Node* node) const
+    {
+        while (node)
+        {
+            Node* const next = node->next.load(std::memory_order_relaxed);
+            destroyNode(node);
+            node = next;
+        }
+    }
+
+    // Counts a change of the bucket's keys, whose lock must be held.
+    void updateSize(std::size_t tableIndex, std::ptrdiff_t delta)
+    {
+        addToSize(mTable[tableIndex].generation(), delta);
+    }
+
+    // Adds delta to the size if the size still counts the given generation. A size of an older generation
+    // means that a clear is in progress: the size is reset on its behalf first. A size of a newer generation
+    // means that the map was cleared after the change, which doesn't count anymore.
+    void addToSize(std::uint64_t generation, std::ptrdiff_t delta)
+    {
+        // without clear the tag stays 0 and the count wraps within the whole word, which size masks
+        if (!MapPolicy::Clearable)
+        {
+            mSize.fetch_add(static_cast<std::uint64_t>(delta), std::memory_order_relaxed);
+            return;
+        }
+
+        const std::uint64_t tag = generation & GenerationTagMask;
+        std::uint64_t size = mSize.load(std::memory_order_relaxed);
+        while (true)
+        {
+            const std::uint64_t sizeTag = size >> SizeBits;
+            std::uint64_t count;
+            if (sizeTag == tag)
+                count = size & SizeMask;
+            else if (((tag - sizeTag) & GenerationTagMask) <= GenerationTagMask / 2)
+                count = 0;
+            else
+                return;
+            // batches count after unlocking, so the count may briefly drop below 0, see size()
+            const std::uint64_t updated = (tag << SizeBits) | ((count + static_cast<std::uint64_t>(delta)) & SizeMask);
+
+            if (mSize.compare_exchange_weak(size, updated, std::memory_order_relaxed))
+                return;
+        }
+    }
+
+    std::unique_lock<NodeList> lockBucket(std::size_t tableIndex, std::true_type) const
+    {
+        return std::unique_lock<NodeList>(mTable[tableIndex]);
+    }
+
+    // A split stripe keeps its lock, but it no longer protects anything: whoever gets hold of it
+    // after the split sees the children and descends. Children are published under the parent lock,
+    // so a thread that has locked a stripe without children really owns its buckets.
+    std::unique_lock<LockPolicy> lockBucket(std::size_t tableIndex, std::false_type) const
+    {
+        Stripe* stripe = &mStripes[getMutexIndex(tableIndex)];
+        std::size_t subStripeKey = getSubStripeKey(tableIndex);
+        while (true)
+        {
+            if (Stripe* children = stripe->children.load(std::memory_order_acquire))
+            {
+                stripe = &children[subStripeKey % SplitFactor];
+                subStripeKey /= SplitFactor;
+                continue;
+            }
+
+            const std::size_t splitThreshold = mSplitThreshold.load(std::memory_order_relaxed);
+            std::unique_lock<LockPolicy> lock(stripe->lock, std::defer_lock);
+            const bool contended = splitThreshold != 0 && !lock.try_lock();
+            if (!lock.owns_lock())
+                lock.lock();
+
+            if (stripe->children.load(std::memory_order_relaxed))
+                continue;
+
+            if (splitThreshold == 0 || !updateContention(*stripe, contended, splitThreshold))
+                return lock;
+
+            split(*stripe);
+        }
+    }
+
+    // Returns true if the stripe should be split. Called with the stripe locked.
+    bool updateContention(Stripe& stripe, bool contended, std::size_t splitThreshold) const
+    {
+        if (contended)
+            stripe.contention += ContendedWeight;
+        else if (stripe.contention)
+            --stripe.contention;
+
+        return stripe.contention >= splitThreshold && (mIndicesPerMutex >> (SplitShift * (stripe.depth + 1))) != 0;
+    }
+
+    // Called with the stripe locked.
+    void split(Stripe& stripe) const
+    {
+        Stripe* children = new Stripe[SplitFactor];
+        for (std::size_t i = 0; i < SplitFactor; ++i)
+            children[i].depth = stripe.depth + 1;
+
+        stripe.children.store(children, std::memory_order_release);
+        mStripeCount.fetch_add(SplitFactor - 1, std::memory_order_relaxed);
+    }
+
+    // Runs fn(threadIndex) for every index below threads, on that many threads where possible, the calling
+    // thread being one of them. Rethrows the first exception thrown by fn once all of them have finished.
+    template<class Function>
+    static void parallelFor(std::size_t threads, Function fn)
+    {
+        std::mutex errorMutex;
+        std::exception_ptr error;
+        auto run = [&](std::size_t thread)
+        {
+            try
+            {
+                fn(thread);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error)
+                    error = std::current_exception();
+            }
+        };
+
+        std::vector<std::thread> workers;
+        std::size_t thread = 1;
+        try
+        {
+            for (; thread < threads; ++thread)
+                workers.push_back(std::thread(run, thread));
+        }
+        catch (const std::system_error&) {}
+        // indices whose thread couldn't be started run here
+        for (; thread < threads; ++thread)
+            run(thread);
+        run(0);
+
+        for (std::thread& worker : workers)
+            worker.join();
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    // Returns an arena with uninitialized memory for count nodes, all counted as live, registered before any
+    // node in it is linked. Returns nullptr if MaxArenas arenas are live already.
+    ArenaHeader* allocateArena(std::size_t count)
+    {
+        static_assert(alignof(Node) <= alignof(std::max_align_t), "arena memory must be suitably aligned for nodes");
+        static_assert(sizeof(ArenaHeader) <= ArenaHeaderSize, "arena nodes must not overlap the header");
+
+        const std::size_t bytes = ArenaHeaderSize + count * sizeof(Node);
+        char* const memory = static_cast<char*>(::operator new(bytes));
+        ArenaHeader* const arena = new (memory) ArenaHeader(count);
+        {
+            std::lock_guard<std::mutex> lock(mArenaMutex);
+            ArenaTable* table = mArenas.load(std::memory_order_relaxed);
+            if (!table)
+            {
+                table = new ArenaTable();
+                mArenas.store(table, std::memory_order_release);
+            }
+
+            const std::size_t arenaCount = table->count.load(std::memory_order_relaxed);
+            if (arenaCount < MaxArenas)
+            {
+                const std::size_t sequence = table->beginWrite();
+                table->begins[arenaCount].store(memory, std::memory_order_relaxed);
+                table->ends[arenaCount].store(memory + bytes, std::memory_order_relaxed);
+                table->count.store(arenaCount + 1, std::memory_order_relaxed);
+                table->endWrite(sequence);
+                return arena;
+            }
+        }
+        arena->~ArenaHeader();
+        ::operator delete(memory);
+        return nullptr;
+    }
+
+    static Node* arenaNodes(ArenaHeader* arena)
+    {
+        return reinterpret_cast<Node*>(reinterpret_cast<char*>(arena) + ArenaHeaderSize);
+    }
+
+    // Arena the node was carved out of, or nullptr. Costs a single load as long as bulkLoad was never called.
+    ArenaHeader* arenaOf(const Node* node) const
+    {
+        const ArenaTable* const table = mArenas.load(std::memory_order_acquire);
+        if (!table)
+            return nullptr;
+
+        // the node's own arena can't be unregistered while the node is live, but others can, moving entries
+        const char* const address = reinterpret_cast<const char*>(node);
+        for (;;)
+        {
+            const std::size_t sequence = table->sequence.load(std::memory_order_acquire);
+            const std::size_t arenaCount = table->count.load(std::memory_order_relaxed);
+            if (arenaCount == 0)
+                return nullptr;
+            if (sequence & 1)
+                continue;
+
+            const char* found = nullptr;
+            for (std::size_t i = 0; i < arenaCount; ++i)
+            {
+                const char* const begin = table->begins[i].load(std::memory_order_relaxed);
+                if (begin < address && address < table->ends[i].load(std::memory_order_relaxed))
+                    found = begin;
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (table->sequence.load(std::memory_order_relaxed) == sequence)
+                return reinterpret_cast<ArenaHeader*>(const_cast<char*>(found));
+        }
+    }
+
+    // Drops count nodes of the arena, which is unregistered and freed once none is left.
+    void releaseArenaNodes(ArenaHeader* arena, std::size_t count) const
+    {
+        if (count == 0 || arena->live.fetch_sub(count, std::memory_order_acq_rel) != count)
+            return;
+
+        {
+            std::lock_guard<std::mutex> lock(mArenaMutex);
+            ArenaTable* const table = mArenas.load(std::memory_order_relaxed);
+            const std::size_t last = table->count.load(std::memory_order_relaxed) - 1;
+            std::size_t i = 0;
+            while (table->begins[i].load(std::memory_order_relaxed) != reinterpret_cast<const char*>(arena))
+                ++i;
+
+            const std::size_t sequence = table->beginWrite();
+            table->begins[i].store(table->begins[last].load(std::memory_order_relaxed), std::memory_order_relaxed);
+            table->ends[i].store(table->ends[last].load(std::memory_order_relaxed), std::memory_order_relaxed);
+            table->count.store(last, std::memory_order_relaxed);
+            table->endWrite(sequence);
+        }
+        arena->~ArenaHeader();
+        ::operator delete(arena);
+    }
+
+    // Builds a node for a key of the bucket, in the bucket's inline slot if it's free.
+    Node* createNode(std::size_t tableIndex, std::size_t hash, const Key& key, const Value& value) const
+    {
+        void* const slot = mTable[tableIndex].claimSlot();
+        Node* node;
+        if (!slot)
+            node = new Node(key, value, nullptr);
+        else
+        {
+            try
+            {
+                node = new (slot) Node(key, value, nullptr);
+            }
+            catch (...)
+            {
+                mTable[tableIndex].releaseSlot();
+                throw;
+            }
+        }
+        node->setHash(hash);
+        return node;
+    }
+
+    // Heap copy of a node, e.g. of an embedded one leaving the map.
+    static Node* copyNode(const Node* node)
+    {
+        Node* const copy = new Node(node->key, node->value(), nullptr);
+        copy->setHash(node->hash());
+        return copy;
+    }
+
+    // Bucket whose inline slot holds the node, or nullptr for nodes stored elsewhere.
+    NodeList* inlineSlotOwner(const Node* node) const
+    {
+        if (!MapPolicy::InlineFirstNode)
+            return nullptr;
+
+        const char* const address = reinterpret_cast<const char*>(node);
+        const char* const table = reinterpret_cast<const char*>(mTable);
+        if (address < table || address >= table + mCapacity * sizeof(NodeList))
+            return nullptr;
+        NodeList* const bucket = &mTable[(address - table) / sizeof(NodeList)];
+        return bucket->holds(node) ? bucket : nullptr;
+    }
+
+    // Whether the node shares its storage with other nodes, in a bulkLoad arena or the table itself.
+    bool isEmbeddedNode(const Node* node) const
+    {
+        return inlineSlotOwner(node) || arenaOf(node);
+    }
+
+    // Frees a node that is no longer linked into any list.
+    void destroyNode(Node* node) const
+    {
+        if (NodeList* bucket = inlineSlotOwner(node))
+        {
+            node->~Node();
+            bucket->releaseSlot();
+        }
+        else if (ArenaHeader* arena = arenaOf(node))
+        {
+            node->~Node();
+            releaseArenaNodes(arena, 1);
+        }
+        else
+            delete node;
+    }
+
+    void combine(CombiningRequest& request)
+    {
+        PublicationList& list = mPublicationLists[getMutexIndex(request.index)];
+
+        // Uncontended fast path: become the combiner without publishing anything.
+        if (tryStartCombining(list))
+        {
+            executeRequests(&request);
+            combinePending(list);
+        }
+        else
+        {
+            CombiningRequest* head = list.requests.load(std::memory_order_relaxed);
+            do
+                request.next = head;
+            while (!list.requests.compare_exchange_weak(head, &request, std::memory_order_release, std::memory_order_relaxed));
+
+            Backoff backoff;
+            while (!request.done.load(std::memory_order_acquire))
+            {
+                if (tryStartCombining(list))
+                    combinePending(list);
+                else
+                    backoff.pause();
+            }
+        }
+
+        // nodes unlinked for the request are destroyed by its publisher, outside the lock
+        if (request.node)
+            destroyNode(request.node);
+        if (request.retired)
+            retireNode(request.retired);
+        if (request.error)
+            std::rethrow_exception(request.error);
+    }
+
+    static bool tryStartCombining(PublicationList& list)
+    {
+        return !list.combining.load(std::memory_order_relaxed) && !list.combining.exchange(true, std::memory_order_acquire);
+    }
+
+    // Executes what has been published so far and gives up the combiner role.
+    void combinePending(PublicationList& list)
+    {
+        for (std::size_t pass = 0; pass < CombiningPasses; ++pass)
+        {
+            CombiningRequest* requests = list.requests.exchange(nullptr, std::memory_order_acquire);
+            if (!requests)
+                break;
+            executeRequests(requests);
+        }
+        list.combining.store(false, std::memory_order_release);
+    }
+
+    void executeRequests(CombiningRequest* requests)
+    {
+        std::unique_lock<BucketLock> lock;
+        while (requests)
+        {
+            // the request lives on its publisher's stack and is gone as soon as it's marked done
+            CombiningRequest* const next = requests->next;
+            try
+            {
+                relockBucket(lock, requests->index);
+                if (Node* node = requests->node)
+                {
+                    requests->node = nullptr;
+                    if (linkLocked(requests->index, node, requests->retired))
+                        updateSize(requests->index, 1);
+                }
+                else if ((requests->retired = mTable[requests->index].unlink(requests->key, requests->hash)))
+                {
+                    updateSize(requests->index, -1);
+                }
+            }
+            catch (...)
+            {
+                requests->error = std::current_exception();
+            }
+            requests->done.store(true, std::memory_order_release);
+            requests = next;
+        }
+    }
+
+private:
+    const std::size_t mCapacity;
+    const std::size_t mMutexCount;
+    const std::size_t mIndicesPerMutex;
+    const StripeMapping mStripeMapping;
+    const Hash mHasher;
+    std::atomic<std::uint64_t> mSize; // see SizeBits
+    std::atomic<std::uint64_t> mGeneration; // bumped by clear
+    NodeList* mTable;
+    Stripe* mStripes; // nullptr with BucketBitLock
+    PublicationList* mPublicationLists; // one per stripe
+    mutable std::atomic<std::size_t> mStripeCount;
+    std::atomic<std::size_t> mSplitThreshold;
+
+    // Address ranges of the live node arenas of bulkLoad, allocated by the first one
+    std::atomic<ArenaTable*> mArenas;
+    mutable std::mutex mArenaMutex; // serializes the writers of mArenas
+
+    RetiredList* const mRetiredLists; // nodes replaced in insert-only maps, freed with the map; nullptr otherwise
+};
+
+template<class Key, class Value, class Hash, class LockPolicy, class MapPolicy>
+struct ConcurrentHashmap<Key, Value, Hash, LockPolicy, MapPolicy>::Stripe
+{
+    Stripe() : children(nullptr), contention(0), depth(0) {}
+    ~Stripe()
+    {
+        delete[] children.load(std::memory_order_relaxed);
+    }
+
+    LockPolicy lock;
+    std::atomic<Stripe*> children;  // SplitFactor sub-stripes once the stripe is split
+    std::size_t contention;         // guarded by lock
+    std::size_t depth;
+};
+
+template<class Key, class Value, class Hash, class LockPolicy, class MapPolicy>
+struct ConcurrentHashmap<Key, Value, Hash, LockPolicy, MapPolicy>::RetiredList
+{
+    std::mutex mutex;
+    std::vector<Node*> nodes;
+};
+
+// Start of a bulkLoad arena, followed by its nodes. The arena is freed when the count of live nodes drops to 0.
+template<class Key, class Value, class Hash, class LockPolicy, class MapPolicy>
+struct ConcurrentHashmap<Key, Value, Hash, LockPolicy, MapPolicy>::ArenaHeader
+{
+    explicit ArenaHeader(std::size_t live) : live(live) {}
+
+    std::atomic<std::size_t> live;
+};
+
+// Address ranges of the live arenas, unordered. Writers hold mArenaMutex and bump the sequence to an odd
+// value while they change entries, readers retry whenever the sequence changed or was odd (a seqlock).
+template<class Key, class Value, class Hash, class LockPolicy, class MapPolicy>
+struct ConcurrentHashmap<Key, Value, Hash, LockPolicy, MapPolicy>::ArenaTable
+{
+    ArenaTable() : sequence(0), count(0)
+    {
+        for (std::size_t i = 0; i < MaxArenas; ++i)
+        {
+            begins[i].store(nullptr, std::memory_order_relaxed);
+            ends[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    std::size_t beginWrite()
+    {
+        const std::size_t start = sequence.load(std::memory_order_relaxed);
+        sequence.store(start + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        return start;
+    }
+
+    void endWrite(std::size_t start)
+    {
+        sequence.store(start + 2, std::memory_order_release);
+    }
+
+    std::atomic<std::size_t> sequence;
+    std::atomic<std::size_t> count;
+    std::atomic<const char*> begins[MaxArenas];
+    std::atomic<const char*> ends[MaxArenas];
+};
+
+// Size change of a batch of operations, applied with a single update of the size as long as the buckets'
+// generation doesn't change. Applied at the latest when it goes out of scope, also when the batch is aborted.
+template<class Key, class Value, class Hash, class LockPolicy, class MapPolicy>
+class ConcurrentHashmap<Key, Value, Hash, LockPolicy, MapPolicy>::SizeUpdate
+{
+public:
+    explicit SizeUpdate(ConcurrentHashmap& hashmap) : mHashmap(hashmap), mGeneration(0), mDelta(0) {}
+
+    ~SizeUpdate()
+    {
+        apply();
+    }
+
+    // Counts a change of the bucket's keys, whose lock must be held.
+    void add(std::size_t tableIndex, std::ptrdiff_t delta)
+    {
+        const std::uint64_t generation = mHashmap.mTable[tableIndex].generation();
+        if (generation != mGeneration)
+            apply();
+        mGeneration = generation;
+        mDelta += delta;
+    }
+
+private:
+    // noncopyable
+    SizeUpdate(const SizeUpdate&) = delete;
+    SizeUpdate& operator=(const SizeUpdate&) = delete;
+
+    void apply()
+    {
+        if (mDelta)
+            mHashmap.addToSize(mGeneration, mDelta);
+        mDelta = 0;
+    }
+
+private:
+    ConcurrentHashmap& mHashmap;
+    std::uint64_t mGeneration;
+    std::ptrdiff_t mDelta;
+};
+
+// Nodes unlinked or replaced under bucket locks, retired when the list goes out of scope: declared before
+// the locks, after they are released. Keeps the Key and Value destructors out of the critical sections.
+template<class Key, class Value, class Hash, class LockPolicy, class MapPolicy>
+class ConcurrentHashmap<Key, Value, Hash, LockPolicy, MapPolicy>::RetiredNodes
+{
+public:
+    explicit RetiredNodes(const ConcurrentHashmap& hashmap) : mHashmap(hashmap) {}
+
+    ~RetiredNodes()
+    {
+        for (Node* node : mNodes)
+            mHashmap.retireNode(node);
+    }
+
+    // Reserves room for count nodes ahead of the locks, so that adding doesn't allocate under them.
+    void reserve(std::size_t count)
+    {
+        mNodes.reserve(count);
+    }
+
+    void add(Node* node)
+    {
+        if (node)
+            mNodes.push_back(node);
+    }
+
+private:
+    // noncopyable
+    RetiredNodes(const RetiredNodes&) = delete;
+    RetiredNodes& operator=(const RetiredNodes&) = delete;
+
+private:
+    const ConcurrentHashmap& mHashmap;
+    std::vector<Node*> mNodes;
+};
+
+// Per-thread write-back buffer for bulk ingestion. Inserts are buffered locally, partitioned by stripe,
+// and a stripe's batch is written under a single lock acquisition once it reaches batchSize entries
+// or on flush. Until then other threads don't see the buffered keys. Not thread-safe itself:
+// every ingesting thread uses its own BulkWriter.
+template<class Key, class Value, class Hash, class LockPolicy, class MapPolicy>
+class ConcurrentHashmap<Key, Value, Hash, LockPolicy, MapPolicy>::BulkWriter
+{
+public:
+    explicit BulkWriter(ConcurrentHashmap& hashmap, std::size_t batchSize = 256) :
+        mHashmap(hashmap),
+        mBatchSize(batchSize ? batchSize : 1),
+        mBatches(hashmap.mMutexCount)
+    {
+    }
+
+    // Flushes the remaining entries. Errors are swallowed here, call flush() first to see them.
+    ~BulkWriter()
+    {
+        try
+        {
+            flush();
+        }
+        catch (...) {}
+
+        for (std::vector<PendingInsert>& batch : mBatches)
+        {
+            for (const PendingInsert& entry : batch)
+                mHashmap.destroyNode(entry.node);
+        }
+    }
+
+    // Builds the entry's node right away, so that flushing only links nodes under the locks.
+    void insert(const Key& key, const Value& value)
+    {
+        const std::size_t hash = mHashmap.mHasher(key);
+        const std::size_t index = mHashmap.getIndexOfHash(hash);
+        std::vector<PendingInsert>& batch = mBatches[mHashmap.getMutexIndex(index)];
+        if (batch.empty())
+            batch.reserve(mBatchSize);
+        NodePtr node(mHashmap.createNode(index, hash, key, value), NodeDeleter{ &mHashmap });
+        batch.push_back(PendingInsert{ index, node.get() });
+        node.release();
+
+        if (batch.size() >= mBatchSize)
+            flushBatch(batch);
+    }
+
+    // Writes all buffered entries to the map.
+    void flush()
+    {
+        for (std::vector<PendingInsert>& batch : mBatches)
+        {
+            if (!batch.empty())
+                flushBatch(batch);
+        }
+    }
+
+private:
+    // noncopyable
+    BulkWriter(const BulkWriter&) = delete;
+    BulkWriter& operator=(const BulkWriter&) = delete;
+
+    struct PendingInsert
+    {
+        std::size_t index;
+        Node* node;
+    };
+
+    void flushBatch(std::vector<PendingInsert>& batch)
+    {
+        SizeUpdate sizeUpdate(mHashmap);
+        RetiredNodes retired(mHashmap);
+        retired.reserve(batch.size());
+        std::size_t applied = 0;
+        try
+        {
+            std::unique_lock<BucketLock> lock;
+            for (; applied < batch.size(); ++applied)
+            {
+                const PendingInsert& entry = batch[applied];
+                mHashmap.relockBucket(lock, entry.index);
+                Node* replaced;
+                if (mHashmap.linkLocked(entry.index, entry.node, replaced))
+                    sizeUpdate.add(entry.index, 1);
+                else
+                    retired.add(replaced);
+            }
+        }
+        catch (...)
+        {
+            // keep the entries that didn't make it for the next flush
+            batch.erase(batch.begin(), batch.begin() + applied);
+            throw;
+        }
+        batch.clear();
+    }
+
+private:
+    ConcurrentHashmap& mHashmap;
+    const std::size_t mBatchSize;
+    std::vector<std::vector<PendingInsert>> mBatches; // one per stripe
+};
+
+// Owns a node extracted from a map, see extract. Inserting the handle into a map of the same type links
+// the node itself, without copying the key or the value and without allocating.
+template<class Key, class Value, class Hash, class LockPolicy, class MapPolicy>
+class ConcurrentHashmap<Key, Value, Hash, LockPolicy, MapPolicy>::NodeHandle
+{
+public:
+    NodeHandle() : mNode(nullptr) {}
+
+    NodeHandle(NodeHandle&& other) : mNode(other.release()) {}
+
+    NodeHandle& operator=(NodeHandle&& other)
+    {
+        if (this != &other)
+        {
+            delete mNode;
+            mNode = other.release();
+        }
+        return *this;
+    }
+
+    ~NodeHandle()
+    {
+        delete mNode;
+    }
+
+    bool empty() const
+    {
+        return mNode == nullptr;
+    }
+
+    const Key& key() const
+    {
+        return mNode->key;
+    }
+
+    Value& value() const
+    {
+        return mNode->value();
+    }
+
+private:
+    friend class ConcurrentHashmap;
+
+    // noncopyable
+    NodeHandle(const NodeHandle&) = delete;
+    NodeHandle& operator=(const NodeHandle&) = delete;
+
+    // Takes a node that isn't part of an arena.
+    explicit NodeHandle(Node* node) : mNode(node) {}
+
+    Node* release()
+    {
+        Node* const node = mNode;
+        mNode = nullptr;
+        return node;
+    }
+
+private:
+    Node* mNode;
+};
+
+// Access to the keys of a transaction from inside transact, which holds their bucket locks.
+// Keys are referred to by their position in the key list given to transact.
+template<class Key, class Value, class Hash, class LockPolicy, class MapPolicy>
+class ConcurrentHashmap<Key, Value, Hash, LockPolicy, MapPolicy>::Transaction
+{
+public:
+    bool find(std::size_t position) const
+    {
+        return bucket(position).find(mKeys[position], mHashes[position]) != nullptr;
+    }
+
+    // Throws ConcurrentHashmapException if key not found.
+    Value& get(std::size_t position) const
+    {
+        if (Node* node = bucket(position).find(mKeys[position], mHashes[position]))
+        {
+            node->updateVersion();
+            return node->value();
+        }
+        throw ConcurrentHashmapException(ConcurrentHashmapException::KeyNotFound);
+    }
+
+    // Returns true if the key is new. A new key's node is built under the transaction's locks.
+    bool insert(std::size_t position, const Value& value)
+    {
+        NodeList& list = bucket(position);
+        if (Node* node = list.find(mKeys[position], mHashes[position]))
+        {
+            node->value() = value;
+            node->updateVersion();
+            return false;
+        }
+
+        list.link(mHashmap.createNode(mIndices[position], mHashes[position], mKeys[position], value));
+        mHashmap.updateSize(mIndices[position], 1);
+        return true;
+    }
+
+    // Returns true if the key was deleted.
+    bool erase(std::size_t position)
+    {
+        Node* node = bucket(position).unlink(mKeys[position], mHashes[position]);
+        if (!node)
+            return false;
+        mHashmap.updateSize(mIndices[position], -1);
+        mRetired.add(node);
+        return true;
+    }
+
+private:
+    friend class ConcurrentHashmap;
+
+    Transaction(ConcurrentHashmap& hashmap, const std::vector<Key>& keys, const std::vector<std::size_t>& hashes,
+        const std::vector<std::size_t>& indices) :
+        mHashmap(hashmap),
+        mKeys(keys),
+        mHashes(hashes),
+        mIndices(indices),
+        mRetired(hashmap)
+    {
+    }
+
+    // noncopyable
+    Transaction(const Transaction&) = delete;
+    Transaction& operator=(const Transaction&) = delete;
+
+    NodeList& bucket(std::size_t position) const
+    {
+        return mHashmap.mTable[mIndices[position]];
+    }
+
+private:
+    ConcurrentHashmap& mHashmap;
+    const std::vector<Key>& mKeys;
+    const std::vector<std::size_t>& mHashes;
+    const std::vector<std::size_t>& mIndices;
+    RetiredNodes mRetired; // erased nodes, destroyed after the locks are released
+};
+
+// Pending flat-combining operation, allocated on the publishing thread's stack
+template<class Key, class Value, class Hash, class LockPolicy, class MapPolicy>
+struct ConcurrentHashmap<Key, Value, Hash, LockPolicy, MapPolicy>::CombiningRequest
+{
+    CombiningRequest(std::size_t index, std::size_t hash, const Key& key, Node* node) :
+        index(index), hash(hash), key(key), node(node), retired(nullptr), next(nullptr), done(false)
+    {
+    }
+
+    const std::size_t index;
+    const std::size_t hash;
+    const Key& key;
+    Node* node; // node to insert, nullptr for erase; owned by the publisher until linked
+    Node* retired; // node replaced or erased by the request
+    CombiningRequest* next;
+    std::atomic<bool> done;
+    std::exception_ptr error;
+};
+
+template<class Key, class Value, class Hash, class LockPolicy, class MapPolicy>
+struct ConcurrentHashmap<Key, Value, Hash, LockPolicy, MapPolicy>::PublicationList
+{
+    PublicationList() : requests(nullptr), combining(false) {}
+
+    std::atomic<CombiningRequest*> requests;
+    std::atomic<bool> combining;
+};
+
+// Singly linked list of the nodes of one bucket. With InlineFirstNodePolicy the list also provides the
+// storage of one of its nodes, which is then linked like any other. With ClearablePolicy it records the
+// generation of the map its nodes belong to, see ConcurrentHashmap::clear. With SortedChainsPolicy the nodes are
+// in ascending order of their hashes; otherwise all hashes are 0 and new keys go to the front.
+// The low bit of the head pointer is free because nodes are at least pointer-aligned;
+// with BucketBitLock it serves as the bucket lock, otherwise it stays zero.
+template<class Key, class Value, class Hash, class LockPolicy, class MapPolicy>
+class ConcurrentHashmap<Key, Value, Hash, LockPolicy, MapPolicy>::NodeList :
+    public InlineNodeSlot<Node, MapPolicy::InlineFirstNode>,
+    public BucketGenerationStorage<MapPolicy::Clearable>
+{
+public:
+    // Nodes are owned and freed by the map, see ConcurrentHashmap::destroyNode.
+    NodeList() : mHead(0) {}
+
+    // hash is the key's full hash, only used by sorted chains.
+    Node* find(const Key& key, std::size_t hash) const
+    {
+        const std::size_t order = chainOrder(hash);
+        for (Node* node = head(); node && node->hash() <= order; node = node->next.load(ReadOrder))
+        {
+            if (node->hash() == order && node->key == key)
+                return node;
+        }
+        return nullptr;
+    }
+
+    template<class Function>
+    void forEach(Function& fn) const
+    {
+        for (const Node* node = head(); node; node = node->next.load(ReadOrder))
+            fn(node->key, node->value());
+    }
+
+    // Inserts a node whose key isn't in the list yet, at the position of its hash.
+    void link(Node* node)
+    {
+        Node* prev = nullptr;
+        Node* next = head();
+        while (next && next->hash() < node->hash())
+        {
+            prev = next;
+            next = next->next.load(std::memory_order_relaxed);
+        }
+        linkAfter(prev, node, next);
+    }
+
+    // Links the node in place of the node with the same key and returns that one, or inserts the node and
+    // returns nullptr. The replaced node keeps its successor, so lock-free readers standing on it can go on.
+    // Sorted chains find the insertion position in the same pass that looks for the key.
+    Node* replace(Node* node)
+    {
+        Node* prev = nullptr;
+        Node* old = head();
+        while (old && old->hash() <= node->hash() && !(old->hash() == node->hash() && old->key == node->key))
+        {
+            prev = old;
+            old = old->next.load(std::memory_order_relaxed);
+        }
+
+        if (!old || old->hash() != node->hash())
+        {
+            if (MapPolicy::SortedChains)
+                linkAfter(prev, node, old);
+            else
+                linkAfter(nullptr, node, head());
+            return nullptr;
+        }
+
+        linkAfter(prev, node, old->next.load(std::memory_order_relaxed));
+        return old;
+    }
+
+    // Removes the node with the key from the list and returns it, or returns nullptr if key not found.
+    Node* unlink(const Key& key, std::size_t hash)
+    {
+        const std::size_t order = chainOrder(hash);
+        Node* prev = nullptr;
+        Node* node = head();
+        while (node && node->hash() <= order && !(node->hash() == order && node->key == key))
+        {
+            prev = node;
+            node = node->next.load(std::memory_order_relaxed);
+        }
+
+        if (!node || node->hash() != order)
+            return nullptr;
+
+        Node* const next = node->next.load(std::memory_order_relaxed);
+        if (prev)
+            prev->next.store(next, std::memory_order_relaxed);
+        else
+            setHead(next);
+        return node;
+    }
+
+    // Removes the nodes for which pred(key, value) returns true and appends them to unlinked.
+    template<class Predicate>
+    void unlinkIf(Predicate& pred, std::vector<Node*>& unlinked)
+    {
+        Node* prev = nullptr;
+        Node* node = head();
+        while (node)
+        {
+            Node* const next = node->next.load(std::memory_order_relaxed);
+            if (pred(node->key, static_cast<const Node*>(node)->value()))
+            {
+                unlinked.push_back(node);
+                if (prev)
+                    prev->next.store(next, std::memory_order_relaxed);
+                else
+                    setHead(next);
+            }
+            else
+            {
+                prev = node;
+            }
+            node = next;
+        }
+    }
+
+    // Empties the list, returns its former nodes.
+    Node* release()
+    {
+        Node* const first = head();
+        setHead(nullptr);
+        return first;
+    }
+
+    // Lockable interface used with BucketBitLock. Acquired with fetch_or, released with a plain store,
+    // since only the holder modifies the head while the bit is set.
+    void lock()
+    {
+        Backoff backoff;
+        while (mHead.fetch_or(LockBit, std::memory_order_acquire) & LockBit)
+        {
+            do
+                backoff.pause();
+            while (mHead.load(std::memory_order_relaxed) & LockBit);
+        }
+    }
+
+    bool try_lock()
+    {
+        return !(mHead.fetch_or(LockBit, std::memory_order_acquire) & LockBit);
+    }
+
+    void unlock()
+    {
+        mHead.store(mHead.load(std::memory_order_relaxed) & ~LockBit, std::memory_order_release);
+    }
+
+private:
     // noncopyable
     NodeList(const NodeList&) = delete;
     NodeList& operator=(const NodeList&) = delete;
 
-    void deleteHead()
+    static const std::uintptr_t LockBit = 1;
+    static_assert(alignof(Node) > LockBit, "Node alignment must leave the lock bit free");
+
+    // Only the readers of InsertOnlyPolicy traverse the list without the lock, and need links to be published
+    // with release stores and followed with acquire loads. Everyone else is ordered by the bucket lock.
+    static const std::memory_order ReadOrder = MapPolicy::InsertOnly ? std::memory_order_acquire : std::memory_order_relaxed;
+    static const std::memory_order PublishOrder = MapPolicy::InsertOnly ? std::memory_order_release : std::memory_order_relaxed;
+
+    // Position of a key's nodes in the chain, see NodeHashStorage.
+    static std::size_t chainOrder(std::size_t hash)
+    {
+        return MapPolicy::SortedChains ? hash : 0;
+    }
+
+    // Links the node between prev, nullptr for the head, and next. Published with PublishOrder, so that
+    // lock-free readers of InsertOnlyPolicy that see it also see its fields.
+    void linkAfter(Node* prev, Node* node, Node* next)
+    {
+        node->next.store(next, std::memory_order_relaxed);
+        if (prev)
+            prev->next.store(node, PublishOrder);
+        else
+            setHead(node);
+    }
+
+    Node* head() const
+    {
+        return reinterpret_cast<Node*>(mHead.load(ReadOrder) & ~LockBit);
+    }
+
+    void setHead(Node* node)
     {
-        Node* oldHead = mHead;
-        mHead = mHead->next;
-        delete oldHead;
+        const std::uintptr_t lockBit = mHead.load(std::memory_order_relaxed) & LockBit;
+        mHead.store(reinterpret_cast<std::uintptr_t>(node) | lockBit, PublishOrder);
     }
 
 private:
-    Node* mHead;
+    std::atomic<std::uintptr_t> mHead;
 };
 
 #endif
\ No newline at end of file
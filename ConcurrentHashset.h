@@ -0,0 +1,309 @@
+#ifndef CONCURRENT_HASH_SET_H
+#define CONCURRENT_HASH_SET_H
+
+#include "ConcurrentHashMap.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+// Concurrent set on the ConcurrentHashmap engine. Nodes hold just the key and the link: the value type is
+// empty and stored as a base class of the node, so nothing is copied or stored for it.
+template<class Key, class Hash = std::hash<Key>, class LockPolicy = std::mutex>
+class ChainedConcurrentHashset
+{
+    struct NoValue {};
+
+public:
+    explicit ChainedConcurrentHashset(
+        std::size_t capacity,
+        std::size_t concurrencyLevel = ConcurrencyLevelDefault,
+        const Hash& hasher = Hash()) :
+        mMap(capacity, concurrencyLevel, hasher)
+    {
+    }
+
+    std::size_t capacity() const
+    {
+        return mMap.capacity();
+    }
+
+    std::size_t size() const
+    {
+        return mMap.size();
+    }
+
+    // Returns true if the key is new.
+    bool insert(const Key& key)
+    {
+        return mMap.insert(key, NoValue());
+    }
+
+    bool contains(const Key& key) const
+    {
+        return mMap.find(key);
+    }
+
+    // Returns true if the key was in the set.
+    bool erase(const Key& key)
+    {
+        return mMap.erase(key);
+    }
+
+    // Writes contains(key) for every key of [first, last) to results, taking each stripe lock about once.
+    template<class ForwardIt, class OutputIt>
+    void containsAll(ForwardIt first, ForwardIt last, OutputIt results) const
+    {
+        mMap.findAll(first, last, results);
+    }
+
+private:
+    ConcurrentHashmap<Key, NoValue, Hash, LockPolicy> mMap;
+};
+
+
+// Concurrent set storing small trivially copyable keys directly in open-addressing tables, one per stripe.
+// A key picks its segment by the high bits of its mixed hash and probes linearly within the segment, under
+// the segment's lock. Segments grow independently (doubling under their own lock) once 3/4 of their slots
+// are used, so capacity is only the initial size. Erased keys leave tombstones, dropped on the next rehash.
+template<class Key, class Hash = std::hash<Key>, class LockPolicy = std::mutex>
+class DenseConcurrentHashset
+{
+    struct Segment;
+
+public:
+    explicit DenseConcurrentHashset(
+        std::size_t capacity,
+        std::size_t concurrencyLevel = ConcurrencyLevelDefault,
+        const Hash& hasher = Hash()) :
+        mSegmentCount(getStripeCount(capacity, concurrencyLevel)),
+        mHasher(hasher),
+        mSize(0),
+        mSegments(new Segment[mSegmentCount])
+    {
+        const std::size_t slots = getSlotCount((capacity + mSegmentCount - 1) / mSegmentCount);
+        for (std::size_t i = 0; i < mSegmentCount; ++i)
+            mSegments[i].reset(slots);
+    }
+
+    ~DenseConcurrentHashset()
+    {
+        delete[] mSegments;
+    }
+
+    // Current number of slots, grows with the set
+    std::size_t capacity() const
+    {
+        std::size_t result = 0;
+        for (std::size_t i = 0; i < mSegmentCount; ++i)
+        {
+            std::lock_guard<LockPolicy> lock(mSegments[i].lock);
+            result += mSegments[i].keys.size();
+        }
+        return result;
+    }
+
+    std::size_t size() const
+    {
+        return mSize;
+    }
+
+    // Returns true if the key is new.
+    bool insert(const Key& key)
+    {
+        const std::uint64_t hash = mixedHash(key);
+        Segment& segment = mSegments[getSegmentIndex(hash)];
+        std::lock_guard<LockPolicy> lock(segment.lock);
+
+        if (segment.find(key, hash) != Segment::NotFound)
+            return false;
+
+        if ((segment.used + 1) * 4 > segment.keys.size() * 3)
+            segment.rehash([this](const Key& k) { return mixedHash(k); });
+        segment.add(key, hash);
+        ++mSize;
+        return true;
+    }
+
+    bool contains(const Key& key) const
+    {
+        const std::uint64_t hash = mixedHash(key);
+        const Segment& segment = mSegments[getSegmentIndex(hash)];
+        std::lock_guard<LockPolicy> lock(segment.lock);
+
+        return segment.find(key, hash) != Segment::NotFound;
+    }
+
+    // Returns true if the key was in the set.
+    bool erase(const Key& key)
+    {
+        const std::uint64_t hash = mixedHash(key);
+        Segment& segment = mSegments[getSegmentIndex(hash)];
+        std::lock_guard<LockPolicy> lock(segment.lock);
+
+        const std::size_t slot = segment.find(key, hash);
+        if (slot == Segment::NotFound)
+            return false;
+
+        segment.states[slot] = Segment::Deleted;
+        --segment.size;
+        --mSize;
+        return true;
+    }
+
+    // Writes contains(key) for every key of [first, last) to results, taking each segment lock once.
+    template<class ForwardIt, class OutputIt>
+    void containsAll(ForwardIt first, ForwardIt last, OutputIt results) const
+    {
+        std::vector<std::pair<std::size_t, std::size_t>> lookups; // (segment, input position)
+        std::vector<std::uint64_t> hashes;
+        std::vector<Key> keys;
+        for (ForwardIt it = first; it != last; ++it)
+        {
+            hashes.push_back(mixedHash(*it));
+            lookups.push_back(std::make_pair(getSegmentIndex(hashes.back()), keys.size()));
+            keys.push_back(*it);
+        }
+        std::sort(lookups.begin(), lookups.end());
+
+        std::vector<char> found(keys.size());
+        std::size_t i = 0;
+        while (i < lookups.size())
+        {
+            const Segment& segment = mSegments[lookups[i].first];
+            std::lock_guard<LockPolicy> lock(segment.lock);
+            for (; i < lookups.size() && &mSegments[lookups[i].first] == &segment; ++i)
+            {
+                const std::size_t position = lookups[i].second;
+                found[position] = segment.find(keys[position], hashes[position]) != Segment::NotFound;
+            }
+        }
+        for (char isFound : found)
+            *results++ = isFound != 0;
+    }
+
+private:
+    // noncopyable
+    DenseConcurrentHashset(const DenseConcurrentHashset&) = delete;
+    DenseConcurrentHashset& operator=(const DenseConcurrentHashset&) = delete;
+
+    // smallest power of two, at least 8, keeping the load at or below 3/4
+    static std::size_t getSlotCount(std::size_t keys)
+    {
+        std::size_t slots = 8;
+        while (slots / 4 * 3 < keys)
+            slots *= 2;
+        return slots;
+    }
+
+    // so that identity hashes of integers spread over segments and slots
+    std::uint64_t mixedHash(const Key& key) const
+    {
+        return mixHash(static_cast<std::uint64_t>(mHasher(key)));
+    }
+
+    // high bits pick the segment, low bits the slot within it
+    std::size_t getSegmentIndex(std::uint64_t hash) const
+    {
+        return static_cast<std::size_t>(hash >> 32) % mSegmentCount;
+    }
+
+private:
+    const std::size_t mSegmentCount;
+    const Hash mHasher;
+    std::atomic<std::size_t> mSize;
+    Segment* mSegments;
+};
+
+template<class Key, class Hash, class LockPolicy>
+struct DenseConcurrentHashset<Key, Hash, LockPolicy>::Segment
+{
+    enum State : unsigned char { Empty, Full, Deleted };
+    static const std::size_t NotFound = static_cast<std::size_t>(-1);
+
+    Segment() : used(0), size(0) {}
+
+    void reset(std::size_t slots)
+    {
+        keys.assign(slots, Key());
+        states.assign(slots, Empty);
+        used = 0;
+        size = 0;
+    }
+
+    std::size_t find(const Key& key, std::uint64_t hash) const
+    {
+        const std::size_t mask = keys.size() - 1;
+        for (std::size_t slot = hash & mask; states[slot] != Empty; slot = (slot + 1) & mask)
+        {
+            if (states[slot] == Full && keys[slot] == key)
+                return slot;
+        }
+        return NotFound;
+    }
+
+    // Stores a key that isn't in the segment, reusing the first tombstone on its probe sequence.
+    void add(const Key& key, std::uint64_t hash)
+    {
+        const std::size_t mask = keys.size() - 1;
+        std::size_t slot = hash & mask;
+        while (states[slot] == Full)
+            slot = (slot + 1) & mask;
+
+        if (states[slot] == Empty)
+            ++used;
+        keys[slot] = key;
+        states[slot] = Full;
+        ++size;
+    }
+
+    // Doubles the slots, or only drops the tombstones if they take up most of the used slots.
+    // Hashes are recomputed from the keys, so the segment needs the set's hasher.
+    template<class Rehasher>
+    void rehash(Rehasher hashOf)
+    {
+        std::vector<Key> oldKeys;
+        std::vector<unsigned char> oldStates;
+        oldKeys.swap(keys);
+        oldStates.swap(states);
+
+        reset(size * 2 < used ? oldKeys.size() : oldKeys.size() * 2);
+        for (std::size_t slot = 0; slot < oldKeys.size(); ++slot)
+        {
+            if (oldStates[slot] == Full)
+                add(oldKeys[slot], hashOf(oldKeys[slot]));
+        }
+    }
+
+    mutable LockPolicy lock;
+    std::vector<Key> keys;
+    std::vector<unsigned char> states;
+    std::size_t used; // full and deleted slots
+    std::size_t size; // full slots
+};
+
+template<class Key, class Hash, class LockPolicy>
+const std::size_t DenseConcurrentHashset<Key, Hash, LockPolicy>::Segment::NotFound;
+
+
+// Whether ConcurrentHashset stores keys of this type in DenseConcurrentHashset.
+template<class Key>
+struct UseDenseHashset : std::integral_constant<bool,
+    std::is_trivially_copyable<Key>::value && std::is_default_constructible<Key>::value && sizeof(Key) <= sizeof(std::uint64_t)>
+{
+};
+
+// Concurrent set, dense for small trivially copyable keys and chained on the map engine otherwise.
+// Both provide insert (returning whether the key was new), contains, erase, containsAll and size.
+template<class Key, class Hash = std::hash<Key>, class LockPolicy = std::mutex>
+using ConcurrentHashset = typename std::conditional<
+    UseDenseHashset<Key>::value && !std::is_same<LockPolicy, BucketBitLock>::value,
+    DenseConcurrentHashset<Key, Hash, LockPolicy>,
+    ChainedConcurrentHashset<Key, Hash, LockPolicy>>::type;
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef CONCURRENT_MULTI_MAP_H
+#define CONCURRENT_MULTI_MAP_H
+
+#include "ConcurrentHashMap.h"
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+
+// Map from a key to a list of values (e.g. user to active sessions) on the ConcurrentHashmap engine.
+// Each key's list lives in its node and is only touched under the bucket lock, in place: appending doesn't
+// copy the list and forEachValue visits the values without copying them. A key exists while its list isn't empty.
+template<class Key, class Value, class Hash = std::hash<Key>, class LockPolicy = std::mutex>
+class ConcurrentMultimap
+{
+    typedef std::vector<Value> ValueList;
+
+public:
+    explicit ConcurrentMultimap(
+        std::size_t capacity,
+        std::size_t concurrencyLevel = ConcurrencyLevelDefault,
+        const Hash& hasher = Hash()) :
+        mMap(capacity, concurrencyLevel, hasher)
+    {
+    }
+
+    std::size_t capacity() const
+    {
+        return mMap.capacity();
+    }
+
+    // Number of keys with at least one value
+    std::size_t size() const
+    {
+        return mMap.size();
+    }
+
+    bool find(const Key& key) const
+    {
+        return mMap.find(key);
+    }
+
+    // Number of values of the key, 0 if key not found.
+    std::size_t count(const Key& key) const
+    {
+        std::size_t result = 0;
+        mMap.visit(key, [&result](const ValueList& values) { result = values.size(); });
+        return result;
+    }
+
+    // Adds the value to the end of the key's list.
+    void append(const Key& key, const Value& value)
+    {
+        mMap.upsert(key, [&value](ValueList& values) { values.push_back(value); });
+    }
+
+    // Erases the key's values for which pred(const Value&) returns true, and the key itself if none remain.
+    // Returns the number of erased values.
+    template<class Predicate>
+    std::size_t eraseValue(const Key& key, Predicate pred)
+    {
+        std::size_t erased = 0;
+        mMap.eraseIf(key, [&pred, &erased](ValueList& values)
+        {
+            const typename ValueList::iterator end = std::remove_if(values.begin(), values.end(),
+                [&pred](const Value& value) { return pred(value); });
+            erased = values.end() - end;
+            values.erase(end, values.end());
+            return values.empty();
+        });
+        return erased;
+    }
+
+    // Erases the key with all its values. Returns true if the key was found.
+    bool erase(const Key& key)
+    {
+        return mMap.erase(key);
+    }
+
+    // Calls fn(const Value&) for every value of the key in list order, under the bucket lock.
+    // fn must not call back into the multimap for keys of the same stripe.
+    template<class Function>
+    void forEachValue(const Key& key, Function fn) const
+    {
+        mMap.visit(key, [&fn](const ValueList& values)
+        {
+            for (const Value& value : values)
+                fn(value);
+        });
+    }
+
+private:
+    ConcurrentHashmap<Key, ValueList, Hash, LockPolicy> mMap;
+};
+
+#endif
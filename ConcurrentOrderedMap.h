@@ -0,0 +1,596 @@
+#ifndef CONCURRENT_ORDERED_MAP_H
+#define CONCURRENT_ORDERED_MAP_H
+
+#include "ConcurrentHashMap.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+
+
+// Sorted map for range and prefix queries, meant to sit next to the hash maps: a lock-free skip list
+// in the style of Fraser and Herlihy & Shavit. A node is erased by marking the low bit of its links,
+// after which any traversal may unlink it. Nodes are freed with epoch based reclamation: every operation
+// announces the global epoch in a participant slot, and unlinked nodes and overwritten values are freed
+// once the epoch has advanced twice past their retirement, when no operation can still be reading them.
+// Scans are weakly consistent: they see the entries present during the whole scan and may or may not
+// see entries inserted or erased meanwhile. Long scans delay reclamation for the whole map.
+template<class Key, class Value, class Compare = std::less<Key>>
+class ConcurrentOrderedMap
+{
+    static const int MaxLevel = 16; // one level per 4 keys, enough for billions of keys
+    static const std::size_t ParticipantCount = 64;
+    static const std::size_t CollectInterval = 64;
+    static const std::size_t CacheLineSize = 64;
+    static const std::uintptr_t Marked = 1;
+
+    typedef std::atomic<std::uintptr_t> Link; // next node, low bit set once the link's owner is erased
+
+    struct Node;
+    struct Participant;
+    struct Retired;
+    class Guard;
+
+public:
+    explicit ConcurrentOrderedMap(const Compare& less = Compare()) :
+        mLess(less),
+        mSize(0),
+        mEpoch(1),
+        mRetired(nullptr),
+        mPendingRetired(0)
+    {
+        for (int level = 0; level < MaxLevel; ++level)
+            mHead[level].store(0, std::memory_order_relaxed);
+    }
+
+    ~ConcurrentOrderedMap()
+    {
+        Node* node = toNode(mHead[0].load(std::memory_order_relaxed));
+        while (node)
+        {
+            Node* next = toNode(node->links()[0].load(std::memory_order_relaxed));
+            destroyNode(node);
+            node = next;
+        }
+        Retired* retired = mRetired.load(std::memory_order_relaxed);
+        while (retired)
+        {
+            Retired* next = retired->next;
+            destroyRetired(retired);
+            retired = next;
+        }
+    }
+
+    std::size_t size() const
+    {
+        return mSize;
+    }
+
+    bool find(const Key& key) const
+    {
+        Guard guard(*this);
+        return findNode(key) != nullptr;
+    }
+
+    // Throws ConcurrentHashmapException if key not found.
+    Value getCopy(const Key& key) const
+    {
+        Guard guard(*this);
+        if (const Node* node = findNode(key))
+            return *node->value.load(std::memory_order_acquire);
+        throw ConcurrentHashmapException(ConcurrentHashmapException::KeyNotFound);
+    }
+
+    // Inserts the pair, or overwrites the value if the key exists. Returns true if the key is new.
+    bool insert(const Key& key, const Value& value)
+    {
+        bool inserted;
+        {
+            Guard guard(*this);
+            inserted = insertGuarded(key, value);
+        }
+        collectIfDue();
+        return inserted;
+    }
+
+    // Returns true if the key was found.
+    bool erase(const Key& key)
+    {
+        bool erased;
+        {
+            Guard guard(*this);
+            erased = eraseGuarded(key);
+        }
+        collectIfDue();
+        return erased;
+    }
+
+    // Copies the entry with the smallest key not less than key to resultKey and resultValue.
+    // Returns false, leaving them untouched, if there is no such entry.
+    bool lowerBound(const Key& key, Key& resultKey, Value& resultValue) const
+    {
+        Guard guard(*this);
+        const Node* node = lowerBoundNode(key);
+        if (!node)
+            return false;
+        resultKey = node->key;
+        resultValue = *node->value.load(std::memory_order_acquire);
+        return true;
+    }
+
+    // Calls fn(const Key&, const Value&) for the entries with keys in [from, to), in key order.
+    // fn runs without locks, but inside the operation's epoch.
+    template<class Function>
+    void rangeScan(const Key& from, const Key& to, Function fn) const
+    {
+        Guard guard(*this);
+        for (const Node* node = lowerBoundNode(from); node && mLess(node->key, to); node = nextNode(node))
+            fn(node->key, *node->value.load(std::memory_order_acquire));
+    }
+
+    // Calls fn(const Key&, const Value&) for the entries whose keys start with prefix, in key order.
+    // Key must be a std::basic_string ordered by its characters, like with the default std::less.
+    template<class Function>
+    void prefixScan(const Key& prefix, Function fn) const
+    {
+        Guard guard(*this);
+        for (const Node* node = lowerBoundNode(prefix); node && node->key.compare(0, prefix.size(), prefix) == 0; node = nextNode(node))
+            fn(node->key, *node->value.load(std::memory_order_acquire));
+    }
+
+private:
+    // noncopyable
+    ConcurrentOrderedMap(const ConcurrentOrderedMap&) = delete;
+    ConcurrentOrderedMap& operator=(const ConcurrentOrderedMap&) = delete;
+
+    static bool isMarked(std::uintptr_t link)
+    {
+        return (link & Marked) != 0;
+    }
+
+    static Node* toNode(std::uintptr_t link)
+    {
+        return reinterpret_cast<Node*>(link & ~Marked);
+    }
+
+    static std::uintptr_t toLink(const Node* node)
+    {
+        return reinterpret_cast<std::uintptr_t>(node);
+    }
+
+    // 1 + number of leading zero bit pairs of a random number, so every level holds about a quarter of the one below
+    static int randomHeight()
+    {
+        static thread_local std::uint64_t state = 0;
+        if (state == 0)
+            state = std::hash<std::thread::id>()(std::this_thread::get_id()) | 1;
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        std::uint64_t random = state * 0x2545F4914F6CDD1Dull;
+
+        int height = 1;
+        while (height < MaxLevel && (random & 3) == 0)
+        {
+            ++height;
+            random >>= 2;
+        }
+        return height;
+    }
+
+    static Node* createNode(const Key& key, int height)
+    {
+        void* memory = ::operator new(sizeof(Node) + height * sizeof(Link));
+        Node* node;
+        try
+        {
+            node = new (memory) Node(key, height);
+        }
+        catch (...)
+        {
+            ::operator delete(memory);
+            throw;
+        }
+        for (int level = 0; level < height; ++level)
+            new (&node->links()[level]) Link(0);
+        return node;
+    }
+
+    // Frees the node and its value.
+    static void destroyNode(Node* node)
+    {
+        delete node->value.load(std::memory_order_relaxed);
+        node->~Node();
+        ::operator delete(node);
+    }
+
+    static void destroyRetired(Retired* retired)
+    {
+        if (retired->node)
+            destroyNode(retired->node);
+        else
+            delete retired->value;
+        delete retired;
+    }
+
+    // Claims a free participant slot and announces the current epoch in it.
+    Participant& enter() const
+    {
+        static thread_local std::size_t hint = std::hash<std::thread::id>()(std::this_thread::get_id());
+        const std::size_t start = hint % ParticipantCount;
+        std::size_t index = start;
+        while (true)
+        {
+            Participant& participant = mParticipants[index];
+            std::uint64_t quiescent = 0;
+            if (participant.epoch.load(std::memory_order_relaxed) == 0 &&
+                participant.epoch.compare_exchange_strong(quiescent, mEpoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst))
+            {
+                hint = index;
+                return participant;
+            }
+            index = (index + 1) % ParticipantCount;
+            // more operations running than slots
+            if (index == start)
+                std::this_thread::yield();
+        }
+    }
+
+    // First node that isn't erased with a key not less than key. Only reads, erased nodes are skipped.
+    Node* lowerBoundNode(const Key& key) const
+    {
+        const Link* pred = mHead;
+        Node* curr = nullptr;
+        for (int level = MaxLevel - 1; level >= 0; --level)
+        {
+            curr = toNode(pred[level].load(std::memory_order_acquire));
+            while (curr)
+            {
+                const std::uintptr_t next = curr->links()[level].load(std::memory_order_acquire);
+                if (!isMarked(next))
+                {
+                    if (!mLess(curr->key, key))
+                        break;
+                    pred = curr->links();
+                }
+                curr = toNode(next);
+            }
+        }
+        return curr;
+    }
+
+    Node* findNode(const Key& key) const
+    {
+        Node* node = lowerBoundNode(key);
+        return node && !mLess(key, node->key) ? node : nullptr;
+    }
+
+    // Next node on level 0 that isn't erased.
+    Node* nextNode(const Node* node) const
+    {
+        Node* next = toNode(node->links()[0].load(std::memory_order_acquire));
+        while (next && isMarked(next->links()[0].load(std::memory_order_acquire)))
+            next = toNode(next->links()[0].load(std::memory_order_acquire));
+        return next;
+    }
+
+    // Replaces the link to curr, erased, with its successor. Returns false if pred's link changed meanwhile.
+    static bool unlinkFrom(Link& link, Node* curr, std::uintptr_t next)
+    {
+        std::uintptr_t expected = toLink(curr);
+        return link.compare_exchange_strong(expected, next & ~Marked, std::memory_order_acq_rel, std::memory_order_relaxed);
+    }
+
+    // Fills preds with the links of the last node before key and succs with the first node not less than key,
+    // on every level, unlinking the erased nodes on the way. Returns false if it has to start over.
+    bool tryFindPosition(const Key& key, Link** preds, Node** succs)
+    {
+        Link* pred = mHead;
+        for (int level = MaxLevel - 1; level >= 0; --level)
+        {
+            Node* curr = toNode(pred[level].load(std::memory_order_acquire));
+            while (curr)
+            {
+                const std::uintptr_t next = curr->links()[level].load(std::memory_order_acquire);
+                if (isMarked(next))
+                {
+                    if (!unlinkFrom(pred[level], curr, next))
+                        return false;
+                }
+                else
+                {
+                    if (!mLess(curr->key, key))
+                        break;
+                    pred = curr->links();
+                }
+                curr = toNode(next);
+            }
+            preds[level] = pred;
+            succs[level] = curr;
+        }
+        return true;
+    }
+
+    // Returns true if succs[0] has the key.
+    bool findPosition(const Key& key, Link** preds, Node** succs)
+    {
+        while (!tryFindPosition(key, preds, succs))
+        {
+        }
+        return succs[0] && !mLess(key, succs[0]->key);
+    }
+
+    // Unlinks the erased node from every level it is linked on. Looks for the node itself rather than its key:
+    // a newer node with the same key may precede it on upper levels.
+    bool tryUnlinkNode(Node* node)
+    {
+        Link* pred = mHead; // last node before the key
+        for (int level = MaxLevel - 1; level >= 0; --level)
+        {
+            Link* prev = pred;
+            Node* curr = toNode(prev[level].load(std::memory_order_acquire));
+            while (curr)
+            {
+                const std::uintptr_t next = curr->links()[level].load(std::memory_order_acquire);
+                if (isMarked(next))
+                {
+                    if (!unlinkFrom(prev[level], curr, next))
+                        return false;
+                    if (curr == node)
+                        break;
+                }
+                else
+                {
+                    if (mLess(node->key, curr->key))
+                        break;
+                    if (mLess(curr->key, node->key))
+                        pred = curr->links();
+                    prev = curr->links();
+                }
+                curr = toNode(next);
+            }
+        }
+        return true;
+    }
+
+    void unlinkNode(Node* node)
+    {
+        while (!tryUnlinkNode(node))
+        {
+        }
+    }
+
+    bool insertGuarded(const Key& key, const Value& value)
+    {
+        Link* preds[MaxLevel];
+        Node* succs[MaxLevel];
+        std::unique_ptr<Value> newValue(new Value(value));
+        Node* node = nullptr;
+        while (true)
+        {
+            if (findPosition(key, preds, succs))
+            {
+                retire(nullptr, succs[0]->value.exchange(newValue.release(), std::memory_order_acq_rel));
+                if (node)
+                    destroyNode(node);
+                return false;
+            }
+
+            if (!node)
+                node = createNode(key, randomHeight());
+            for (int level = 0; level < node->height; ++level)
+                node->links()[level].store(toLink(succs[level]), std::memory_order_relaxed);
+            node->value.store(newValue.get(), std::memory_order_relaxed);
+
+            std::uintptr_t expected = toLink(succs[0]);
+            if (preds[0][0].compare_exchange_strong(expected, toLink(node), std::memory_order_release, std::memory_order_relaxed))
+                break;
+            node->value.store(nullptr, std::memory_order_relaxed);
+        }
+        newValue.release();
+        ++mSize;
+
+        // Upper levels are only shortcuts, the node is in the map once linked on level 0.
+        for (int level = 1; level < node->height && linkOnLevel(node, level, preds, succs); ++level)
+        {
+        }
+        // erased while being linked: the eraser may have missed links made after its unlinking
+        if (isMarked(node->links()[0].load(std::memory_order_acquire)))
+            unlinkNode(node);
+        release(node);
+        return true;
+    }
+
+    // Returns false if the node was erased, so that it must not be linked any further.
+    bool linkOnLevel(Node* node, int level, Link** preds, Node** succs)
+    {
+        while (true)
+        {
+            // only erasing sets a mark on the node's links, then the CAS fails
+            std::uintptr_t next = node->links()[level].load(std::memory_order_acquire);
+            if (isMarked(next) ||
+                (next != toLink(succs[level]) &&
+                 !node->links()[level].compare_exchange_strong(next, toLink(succs[level]), std::memory_order_acq_rel)))
+            {
+                return false;
+            }
+
+            std::uintptr_t expected = toLink(succs[level]);
+            if (preds[level][level].compare_exchange_strong(expected, toLink(node), std::memory_order_release, std::memory_order_relaxed))
+                return true;
+            findPosition(node->key, preds, succs);
+        }
+    }
+
+    bool eraseGuarded(const Key& key)
+    {
+        Link* preds[MaxLevel];
+        Node* succs[MaxLevel];
+        if (!findPosition(key, preds, succs))
+            return false;
+
+        Node* node = succs[0];
+        for (int level = node->height - 1; level > 0; --level)
+            node->links()[level].fetch_or(Marked, std::memory_order_acq_rel);
+
+        // marking level 0 erases the key, a concurrent erase may have done it first
+        std::uintptr_t next = node->links()[0].load(std::memory_order_acquire);
+        do
+        {
+            if (isMarked(next))
+                return false;
+        }
+        while (!node->links()[0].compare_exchange_weak(next, next | Marked, std::memory_order_acq_rel, std::memory_order_acquire));
+        --mSize;
+
+        unlinkNode(node);
+        release(node);
+        return true;
+    }
+
+    // The inserter and the eraser both release the node when done with it; the last one retires it,
+    // once it can't be linked anymore.
+    void release(Node* node)
+    {
+        if (node->owners.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            retire(node, nullptr);
+    }
+
+    // Queues an unlinked node or an overwritten value to be freed two epochs later.
+    void retire(Node* node, Value* value)
+    {
+        Retired* retired = new Retired{ mRetired.load(std::memory_order_relaxed), mEpoch.load(std::memory_order_seq_cst), node, value };
+        while (!mRetired.compare_exchange_weak(retired->next, retired, std::memory_order_release, std::memory_order_relaxed))
+        {
+        }
+        ++mPendingRetired;
+    }
+
+    // Advances the epoch if every running operation has announced the current one.
+    void tryAdvanceEpoch()
+    {
+        std::uint64_t epoch = mEpoch.load(std::memory_order_seq_cst);
+        for (const Participant& participant : mParticipants)
+        {
+            const std::uint64_t announced = participant.epoch.load(std::memory_order_seq_cst);
+            if (announced != 0 && announced != epoch)
+                return;
+        }
+        mEpoch.compare_exchange_strong(epoch, epoch + 1, std::memory_order_seq_cst);
+    }
+
+    // Called outside of any epoch, so that the caller doesn't hold the epoch back itself.
+    void collectIfDue()
+    {
+        if (mPendingRetired < CollectInterval)
+            return;
+        std::unique_lock<std::mutex> lock(mCollectMutex, std::try_to_lock);
+        if (!lock)
+            return;
+
+        mPendingRetired = 0;
+        tryAdvanceEpoch();
+        const std::uint64_t epoch = mEpoch.load(std::memory_order_seq_cst);
+
+        Retired* retired = mRetired.exchange(nullptr, std::memory_order_acquire);
+        Retired* kept = nullptr;
+        Retired* keptTail = nullptr;
+        while (retired)
+        {
+            Retired* next = retired->next;
+            if (retired->epoch + 2 <= epoch)
+            {
+                destroyRetired(retired);
+            }
+            else
+            {
+                retired->next = kept;
+                kept = retired;
+                if (!keptTail)
+                    keptTail = retired;
+                ++mPendingRetired;
+            }
+            retired = next;
+        }
+        if (kept)
+        {
+            keptTail->next = mRetired.load(std::memory_order_relaxed);
+            while (!mRetired.compare_exchange_weak(keptTail->next, kept, std::memory_order_release, std::memory_order_relaxed))
+            {
+            }
+        }
+    }
+
+private:
+    const Compare mLess;
+    std::atomic<std::size_t> mSize;
+    Link mHead[MaxLevel];
+    std::atomic<std::uint64_t> mEpoch; // starts at 1, 0 marks a quiescent participant
+    mutable Participant mParticipants[ParticipantCount];
+    std::atomic<Retired*> mRetired;
+    std::atomic<std::size_t> mPendingRetired;
+    std::mutex mCollectMutex;
+};
+
+// Links follow the node in the same allocation, as many as the node's height.
+template<class Key, class Value, class Compare>
+struct ConcurrentOrderedMap<Key, Value, Compare>::Node
+{
+    Node(const Key& key, int height) : key(key), value(nullptr), height(height), owners(2) {}
+
+    Link* links()
+    {
+        return reinterpret_cast<Link*>(this + 1);
+    }
+
+    const Link* links() const
+    {
+        return reinterpret_cast<const Link*>(this + 1);
+    }
+
+    const Key key;
+    std::atomic<Value*> value; // swapped on overwrite, so readers can copy the old one meanwhile
+    const int height;
+    std::atomic<int> owners;   // inserter and eraser
+};
+
+// Padded so that operations announcing their epochs don't share cache lines.
+template<class Key, class Value, class Compare>
+struct ConcurrentOrderedMap<Key, Value, Compare>::Participant
+{
+    Participant() : epoch(0) {}
+
+    std::atomic<std::uint64_t> epoch;
+    char padding[CacheLineSize - sizeof(std::atomic<std::uint64_t>)];
+};
+
+template<class Key, class Value, class Compare>
+struct ConcurrentOrderedMap<Key, Value, Compare>::Retired
+{
+    Retired* next;
+    std::uint64_t epoch;
+    Node* node;   // freed with its value, or
+    Value* value; // an overwritten value
+};
+
+// Announces the current epoch for the scope of an operation.
+template<class Key, class Value, class Compare>
+class ConcurrentOrderedMap<Key, Value, Compare>::Guard
+{
+public:
+    explicit Guard(const ConcurrentOrderedMap& map) : mParticipant(map.enter()) {}
+
+    ~Guard()
+    {
+        mParticipant.epoch.store(0, std::memory_order_release);
+    }
+
+private:
+    Participant& mParticipant;
+};
+
+#endif
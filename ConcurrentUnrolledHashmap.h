@@ -0,0 +1,344 @@
+#ifndef CONCURRENT_UNROLLED_HASH_MAP_H
+#define CONCURRENT_UNROLLED_HASH_MAP_H
+
+#include "ConcurrentHashMap.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+
+// Largest number of entries, down from count, that fits in a chunk of chunkSize bytes laid out as
+// next pointer, entry count, one tag per entry, then the entries. At least 1.
+constexpr std::size_t unrolledChunkEntries(std::size_t entrySize, std::size_t entryAlignment, std::size_t chunkSize, std::size_t count)
+{
+    return count > 1 && (sizeof(void*) + 1 + count + entryAlignment - 1) / entryAlignment * entryAlignment + count * entrySize > chunkSize ?
+        unrolledChunkEntries(entrySize, entryAlignment, chunkSize, count - 1) : (count ? count : 1);
+}
+
+
+// Striped map for tables run at high load factors to save memory, where chains do get long. Chains are
+// unrolled: each chain is a list of cache-line-aligned chunks of ChunkSize bytes (64 or 128) holding several
+// entries, with a one-byte tag of every entry's hash in the chunk header. A lookup compares the tags of a chunk
+// and only reads the keys whose tag matches, so a walk over n entries touches about n / EntriesPerChunk cache
+// lines instead of n nodes. Inserting fills the first chunk of the chain with room; erasing moves the chunk's
+// last entry into the hole and frees chunks that become empty. Keys hash to buckets like in ConcurrentHashmap
+// and buckets share stripe locks by index modulo the stripe count.
+template<class Key, class Value, class Hash = std::hash<Key>, class LockPolicy = std::mutex, std::size_t ChunkSize = 64>
+class ConcurrentUnrolledHashmap
+{
+    static const std::size_t CacheLineSize = 64;
+
+    static_assert(ChunkSize % CacheLineSize == 0, "ChunkSize must be a multiple of the cache line size");
+
+    struct Entry
+    {
+        Entry(const Key& key, const Value& value) : key(key), value(value) {}
+
+        Key key;
+        Value value;
+    };
+
+public:
+    // Entries of one chunk, at least 1 even if an entry alone doesn't fit in ChunkSize bytes.
+    static const std::size_t EntriesPerChunk = unrolledChunkEntries(sizeof(Entry), alignof(Entry), ChunkSize,
+        ChunkSize / (sizeof(Entry) + 1) < 255 ? ChunkSize / (sizeof(Entry) + 1) : 255);
+
+    explicit ConcurrentUnrolledHashmap(
+        std::size_t capacity,
+        std::size_t concurrencyLevel = ConcurrencyLevelDefault,
+        const Hash& hasher = Hash()) :
+        mCapacity(capacity),
+        mMutexCount(getStripeCount(capacity, concurrencyLevel)),
+        mHasher(hasher),
+        mSize(0),
+        mTable(new Chunk*[capacity]()),
+        mMutexes(new LockPolicy[mMutexCount])
+    {
+    }
+
+    ~ConcurrentUnrolledHashmap()
+    {
+        for (std::size_t i = 0; i < mCapacity; ++i)
+        {
+            Chunk* chunk = mTable[i];
+            while (chunk)
+            {
+                Chunk* const next = chunk->next;
+                destroyChunk(chunk);
+                chunk = next;
+            }
+        }
+        delete[] mMutexes;
+        delete[] mTable;
+    }
+
+    // Number of buckets
+    std::size_t capacity() const
+    {
+        return mCapacity;
+    }
+
+    std::size_t size() const
+    {
+        return mSize;
+    }
+
+    bool find(const Key& key) const
+    {
+        const std::uint64_t hash = mixedHash(key);
+        const std::size_t index = getIndex(hash);
+        std::lock_guard<LockPolicy> lock(getMutex(index));
+
+        return findEntry(index, key, getTag(hash)) != nullptr;
+    }
+
+    // Returns copy of value stored in the map or throws ConcurrentHashmapException if the key is not found.
+    Value getCopy(const Key& key) const
+    {
+        const std::uint64_t hash = mixedHash(key);
+        const std::size_t index = getIndex(hash);
+        std::lock_guard<LockPolicy> lock(getMutex(index));
+
+        if (const Entry* entry = findEntry(index, key, getTag(hash)))
+            return entry->value;
+        throw ConcurrentHashmapException(ConcurrentHashmapException::KeyNotFound);
+    }
+
+    // Inserts the key or overwrites its value. Returns true if the key is new. If every chunk of the chain
+    // is full, a new chunk is allocated with the lock released and the insert starts over.
+    bool insert(const Key& key, const Value& value)
+    {
+        const std::uint64_t hash = mixedHash(key);
+        const std::size_t index = getIndex(hash);
+        const std::uint8_t tag = getTag(hash);
+        ChunkPtr spare; // declared before the lock, so that an unused chunk is freed after releasing it
+
+        while (true)
+        {
+            {
+                std::lock_guard<LockPolicy> lock(getMutex(index));
+
+                // one pass looks for the key and for the first chunk with room
+                Chunk* free = nullptr;
+                for (Chunk* chunk = mTable[index]; chunk; chunk = chunk->next)
+                {
+                    for (std::size_t i = 0; i < chunk->count; ++i)
+                    {
+                        if (chunk->tags[i] == tag && chunk->entry(i).key == key)
+                        {
+                            chunk->entry(i).value = value;
+                            return false;
+                        }
+                    }
+                    if (!free && chunk->count < EntriesPerChunk)
+                        free = chunk;
+                }
+
+                if (!free && spare)
+                {
+                    spare->next = mTable[index];
+                    mTable[index] = free = spare.release();
+                }
+                if (free)
+                {
+                    try
+                    {
+                        new (free->slot(free->count)) Entry(key, value);
+                    }
+                    catch (...)
+                    {
+                        if (free->count == 0)
+                        {
+                            mTable[index] = free->next;
+                            spare.reset(free);
+                        }
+                        throw;
+                    }
+                    free->tags[free->count++] = tag;
+                    ++mSize;
+                    return true;
+                }
+            }
+            spare.reset(createChunk(nullptr));
+        }
+    }
+
+    // Returns true if the key was deleted.
+    bool erase(const Key& key)
+    {
+        const std::uint64_t hash = mixedHash(key);
+        const std::size_t index = getIndex(hash);
+        const std::uint8_t tag = getTag(hash);
+        std::lock_guard<LockPolicy> lock(getMutex(index));
+
+        Chunk* prev = nullptr;
+        for (Chunk* chunk = mTable[index]; chunk; prev = chunk, chunk = chunk->next)
+        {
+            for (std::size_t i = 0; i < chunk->count; ++i)
+            {
+                if (chunk->tags[i] != tag || chunk->entry(i).key != key)
+                    continue;
+
+                const std::size_t last = chunk->count - 1;
+                if (i != last)
+                {
+                    chunk->entry(i) = std::move(chunk->entry(last));
+                    chunk->tags[i] = chunk->tags[last];
+                }
+                chunk->entry(last).~Entry();
+                chunk->count = static_cast<std::uint8_t>(last);
+                --mSize;
+
+                if (chunk->count == 0)
+                {
+                    if (prev)
+                        prev->next = chunk->next;
+                    else
+                        mTable[index] = chunk->next;
+                    destroyChunk(chunk);
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Calls fn(key, value) for every entry while holding the entry's stripe lock, one bucket at a time.
+    template<class Function>
+    void forEach(Function fn) const
+    {
+        for (std::size_t index = 0; index < mCapacity; ++index)
+        {
+            std::lock_guard<LockPolicy> lock(getMutex(index));
+            for (const Chunk* chunk = mTable[index]; chunk; chunk = chunk->next)
+            {
+                for (std::size_t i = 0; i < chunk->count; ++i)
+                    fn(chunk->entry(i).key, chunk->entry(i).value);
+            }
+        }
+    }
+
+private:
+    // noncopyable
+    ConcurrentUnrolledHashmap(const ConcurrentUnrolledHashmap&) = delete;
+    ConcurrentUnrolledHashmap& operator=(const ConcurrentUnrolledHashmap&) = delete;
+
+    struct Chunk
+    {
+        explicit Chunk(Chunk* next) : next(next), count(0) {}
+
+        void* slot(std::size_t i)
+        {
+            return &entries[i];
+        }
+
+        Entry& entry(std::size_t i)
+        {
+            return *reinterpret_cast<Entry*>(&entries[i]);
+        }
+
+        const Entry& entry(std::size_t i) const
+        {
+            return *reinterpret_cast<const Entry*>(&entries[i]);
+        }
+
+        Chunk* next;
+        std::uint8_t count;
+        std::uint8_t tags[EntriesPerChunk];
+        typename std::aligned_storage<sizeof(Entry), alignof(Entry)>::type entries[EntriesPerChunk];
+    };
+
+    struct ChunkDeleter
+    {
+        void operator()(Chunk* chunk) const
+        {
+            destroyChunk(chunk);
+        }
+    };
+    typedef std::unique_ptr<Chunk, ChunkDeleter> ChunkPtr;
+
+    // Chunks start on a cache line, so that the tags of a chunk are read with a single miss.
+    static Chunk* createChunk(Chunk* next)
+    {
+#if defined(_WIN32)
+        void* const memory = _aligned_malloc(sizeof(Chunk), CacheLineSize);
+        if (!memory)
+            throw std::bad_alloc();
+#else
+        void* memory = nullptr;
+        if (posix_memalign(&memory, CacheLineSize, sizeof(Chunk)) != 0)
+            throw std::bad_alloc();
+#endif
+        return new (memory) Chunk(next);
+    }
+
+    static void destroyChunk(Chunk* chunk)
+    {
+        for (std::size_t i = 0; i < chunk->count; ++i)
+            chunk->entry(i).~Entry();
+        chunk->~Chunk();
+#if defined(_WIN32)
+        _aligned_free(chunk);
+#else
+        std::free(chunk);
+#endif
+    }
+
+    // the low bits pick the bucket and the top byte is the tag, so both need mixing
+    std::uint64_t mixedHash(const Key& key) const
+    {
+        return mixHash(static_cast<std::uint64_t>(mHasher(key)));
+    }
+
+    std::size_t getIndex(std::uint64_t hash) const
+    {
+        return static_cast<std::size_t>(hash % mCapacity);
+    }
+
+    static std::uint8_t getTag(std::uint64_t hash)
+    {
+        return static_cast<std::uint8_t>(hash >> 56);
+    }
+
+    LockPolicy& getMutex(std::size_t index) const
+    {
+        return mMutexes[index % mMutexCount];
+    }
+
+    const Entry* findEntry(std::size_t index, const Key& key, std::uint8_t tag) const
+    {
+        for (const Chunk* chunk = mTable[index]; chunk; chunk = chunk->next)
+        {
+            for (std::size_t i = 0; i < chunk->count; ++i)
+            {
+                if (chunk->tags[i] == tag && chunk->entry(i).key == key)
+                    return &chunk->entry(i);
+            }
+        }
+        return nullptr;
+    }
+
+private:
+    const std::size_t mCapacity;
+    const std::size_t mMutexCount;
+    const Hash mHasher;
+    std::atomic<std::size_t> mSize;
+    Chunk** mTable;
+    LockPolicy* mMutexes; // bucket index modulo mutex count
+};
+
+template<class Key, class Value, class Hash, class LockPolicy, std::size_t ChunkSize>
+const std::size_t ConcurrentUnrolledHashmap<Key, Value, Hash, LockPolicy, ChunkSize>::EntriesPerChunk;
+
+#endif
@@ -0,0 +1,357 @@
+#ifndef DELEGATED_HASH_MAP_H
+#define DELEGATED_HASH_MAP_H
+
+#include "ConcurrentHashMap.h"
+#include "LockPolicies.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Shared-nothing hashmap: every shard is owned by a worker thread which is the only one touching it,
+// so the shards need no locks. Other threads send operations to the owner over a lock-free MPSC queue
+// and the owner executes them in batches. Writes are fire-and-forget, reads return futures.
+// Operations sent by one thread to a shard are executed in the order they were sent.
+template<class Key, class Value, class Hash = std::hash<Key>>
+class DelegatedHashmap
+{
+    typedef ConcurrentHashmap<Key, Value, Hash, NullLock> ShardMap;
+    class Message;
+    class Shard;
+
+public:
+    // Capacity is divided between the shards. One shard per hardware thread by default.
+    explicit DelegatedHashmap(
+        std::size_t capacity,
+        std::size_t shardCount = std::thread::hardware_concurrency(),
+        const Hash& hasher = Hash()) :
+        mHasher(hasher)
+    {
+        if (capacity == 0)
+            throw ConcurrentHashmapException(ConcurrentHashmapException::InvalidCapacity);
+        if (shardCount == 0)
+            shardCount = 1;
+
+        const std::size_t shardCapacity = (capacity + shardCount - 1) / shardCount;
+        for (std::size_t i = 0; i < shardCount; ++i)
+            mShards.push_back(std::unique_ptr<Shard>(new Shard(shardCapacity, hasher)));
+    }
+
+    // Executes all operations sent so far, then stops the workers.
+    ~DelegatedHashmap()
+    {
+        mShards.clear();
+    }
+
+    std::size_t shardCount() const
+    {
+        return mShards.size();
+    }
+
+    // Number of keys stored by the operations executed so far
+    std::size_t size() const
+    {
+        std::size_t result = 0;
+        for (const std::unique_ptr<Shard>& shard : mShards)
+            result += shard->map().size();
+        return result;
+    }
+
+    // Fire-and-forget. Errors thrown while executing the operation (e.g. std::bad_alloc) are dropped.
+    void insert(const Key& key, const Value& value)
+    {
+        shardFor(key).send(new InsertMessage(key, value));
+    }
+
+    // Fire-and-forget
+    void erase(const Key& key)
+    {
+        shardFor(key).send(new EraseMessage(key));
+    }
+
+    std::future<bool> find(const Key& key)
+    {
+        FindMessage* message = new FindMessage(key);
+        std::future<bool> result = message->promise.get_future();
+        shardFor(key).send(message);
+        return result;
+    }
+
+    // The future throws ConcurrentHashmapException if the key is not found.
+    std::future<Value> getCopy(const Key& key)
+    {
+        GetCopyMessage* message = new GetCopyMessage(key);
+        std::future<Value> result = message->promise.get_future();
+        shardFor(key).send(message);
+        return result;
+    }
+
+    // The future becomes ready once every shard has executed the operations the calling thread sent before.
+    std::future<void> flush()
+    {
+        std::shared_ptr<FlushState> state = std::make_shared<FlushState>(mShards.size());
+        std::future<void> result = state->promise.get_future();
+        for (const std::unique_ptr<Shard>& shard : mShards)
+            shard->send(new FlushMessage(state));
+        return result;
+    }
+
+private:
+    // noncopyable
+    DelegatedHashmap(const DelegatedHashmap&) = delete;
+    DelegatedHashmap& operator=(const DelegatedHashmap&) = delete;
+
+    Shard& shardFor(const Key& key) const
+    {
+        const std::uint64_t hash = static_cast<std::uint64_t>(mHasher(key));
+        return *mShards[static_cast<std::size_t>(fibonacciHash(hash)) % mShards.size()];
+    }
+
+    class InsertMessage;
+    class EraseMessage;
+    class FindMessage;
+    class GetCopyMessage;
+    class FlushMessage;
+    struct FlushState;
+
+private:
+    const Hash mHasher;
+    std::vector<std::unique_ptr<Shard>> mShards;
+};
+
+
+// Queue entry. Messages are intrusively linked into Vyukov's MPSC queue.
+template<class Key, class Value, class Hash>
+class DelegatedHashmap<Key, Value, Hash>::Message
+{
+public:
+    Message() : next(nullptr) {}
+    virtual ~Message() {}
+
+    virtual void execute(ShardMap&) {}
+
+    std::atomic<Message*> next;
+};
+
+template<class Key, class Value, class Hash>
+class DelegatedHashmap<Key, Value, Hash>::InsertMessage : public Message
+{
+public:
+    InsertMessage(const Key& key, const Value& value) : mKey(key), mValue(value) {}
+
+    void execute(ShardMap& map) override
+    {
+        try
+        {
+            map.insert(mKey, mValue);
+        }
+        catch (...) {}
+    }
+
+private:
+    const Key mKey;
+    const Value mValue;
+};
+
+template<class Key, class Value, class Hash>
+class DelegatedHashmap<Key, Value, Hash>::EraseMessage : public Message
+{
+public:
+    explicit EraseMessage(const Key& key) : mKey(key) {}
+
+    void execute(ShardMap& map) override
+    {
+        map.erase(mKey);
+    }
+
+private:
+    const Key mKey;
+};
+
+template<class Key, class Value, class Hash>
+class DelegatedHashmap<Key, Value, Hash>::FindMessage : public Message
+{
+public:
+    explicit FindMessage(const Key& key) : mKey(key) {}
+
+    void execute(ShardMap& map) override
+    {
+        promise.set_value(map.find(mKey));
+    }
+
+    std::promise<bool> promise;
+
+private:
+    const Key mKey;
+};
+
+template<class Key, class Value, class Hash>
+class DelegatedHashmap<Key, Value, Hash>::GetCopyMessage : public Message
+{
+public:
+    explicit GetCopyMessage(const Key& key) : mKey(key) {}
+
+    void execute(ShardMap& map) override
+    {
+        try
+        {
+            promise.set_value(map.getCopy(mKey));
+        }
+        catch (...)
+        {
+            promise.set_exception(std::current_exception());
+        }
+    }
+
+    std::promise<Value> promise;
+
+private:
+    const Key mKey;
+};
+
+template<class Key, class Value, class Hash>
+struct DelegatedHashmap<Key, Value, Hash>::FlushState
+{
+    explicit FlushState(std::size_t shardCount) : remaining(shardCount) {}
+
+    std::atomic<std::size_t> remaining;
+    std::promise<void> promise;
+};
+
+template<class Key, class Value, class Hash>
+class DelegatedHashmap<Key, Value, Hash>::FlushMessage : public Message
+{
+public:
+    explicit FlushMessage(const std::shared_ptr<FlushState>& state) : mState(state) {}
+
+    void execute(ShardMap&) override
+    {
+        if (mState->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            mState->promise.set_value();
+    }
+
+private:
+    std::shared_ptr<FlushState> mState;
+};
+
+
+// Shard map together with its owner thread and the owner's inbox.
+// The worker spins briefly when the inbox runs dry and then parks until a sender wakes it up.
+template<class Key, class Value, class Hash>
+class DelegatedHashmap<Key, Value, Hash>::Shard
+{
+public:
+    Shard(std::size_t capacity, const Hash& hasher) :
+        mMap(capacity, 1, hasher),
+        mHead(&mStub),
+        mTail(&mStub),
+        mParked(false),
+        mStopping(false),
+        mWorker(&Shard::run, this)
+    {
+    }
+
+    ~Shard()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mParkMutex);
+            mStopping = true;
+        }
+        mWakeUp.notify_one();
+        mWorker.join();
+        if (mTail != &mStub)
+            delete mTail;
+    }
+
+    const ShardMap& map() const
+    {
+        return mMap;
+    }
+
+    void send(Message* message)
+    {
+        Message* prev = mHead.exchange(message, std::memory_order_seq_cst);
+        // seq_cst pairs with the worker's store to mParked followed by its emptiness check
+        prev->next.store(message, std::memory_order_seq_cst);
+
+        if (mParked.load(std::memory_order_seq_cst))
+        {
+            std::lock_guard<std::mutex> lock(mParkMutex);
+            mWakeUp.notify_one();
+        }
+    }
+
+private:
+    static const int SpinsBeforeParking = 64;
+
+    // Single consumer side of the queue. The returned message becomes the queue's new stub;
+    // the previous one is deleted here.
+    Message* pop()
+    {
+        Message* next = mTail->next.load(std::memory_order_acquire);
+        if (!next)
+            return nullptr;
+
+        if (mTail != &mStub)
+            delete mTail;
+        mTail = next;
+        return next;
+    }
+
+    // seq_cst, so that the check can't be ordered before the worker's store to mParked: either the worker
+    // sees the sender's message or the sender sees mParked set
+    bool empty() const
+    {
+        return !mTail->next.load(std::memory_order_seq_cst);
+    }
+
+    void run()
+    {
+        int idleSpins = 0;
+        while (true)
+        {
+            if (Message* message = pop())
+            {
+                message->execute(mMap);
+                idleSpins = 0;
+                continue;
+            }
+
+            if (++idleSpins < SpinsBeforeParking)
+            {
+                cpuRelax();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(mParkMutex);
+            mParked.store(true, std::memory_order_seq_cst);
+            if (empty())
+            {
+                if (mStopping)
+                    return;
+                mWakeUp.wait(lock);
+            }
+            mParked.store(false, std::memory_order_relaxed);
+            idleSpins = 0;
+        }
+    }
+
+private:
+    ShardMap mMap;
+    Message mStub;
+    std::atomic<Message*> mHead; // producers push here
+    Message* mTail;              // consumer only
+    std::atomic<bool> mParked;
+    bool mStopping;              // guarded by mParkMutex
+    std::mutex mParkMutex;
+    std::condition_variable mWakeUp;
+    std::thread mWorker;
+};
+
+#endif
@@ -0,0 +1,295 @@
+#ifndef FROZEN_HASH_MAP_H
+#define FROZEN_HASH_MAP_H
+
+#include "ConcurrentHashMap.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+
+
+// Immutable map built around a minimal perfect hash (CHD, "hash, displace and compress").
+// Keys are grouped into small buckets by one hash function, and every bucket gets a displacement
+// that sends its keys to distinct free slots of a table with exactly one slot per key.
+// A lookup reads the bucket's displacement and then compares a single slot, without any locking;
+// concurrent readers are safe because nothing is ever written after construction.
+// Keys whose full hash equals an earlier key's can't be told apart by any displacement; they go to an
+// overflow list sorted by hash, which lookups binary-search when the slot doesn't hold the key.
+template<class Key, class Value, class Hash = std::hash<Key>>
+class FrozenHashmap
+{
+public:
+    typedef std::pair<Key, Value> Entry;
+
+    // Keys must be unique. Throws ConcurrentHashmapException(PerfectHashConstructionFailed)
+    // if no seed yields displacements for all buckets, which is very unlikely.
+    explicit FrozenHashmap(std::vector<Entry> entries, const Hash& hasher = Hash()) :
+        mHasher(hasher),
+        mSeed(0),
+        mSlotCount(0)
+    {
+        const std::size_t count = entries.size();
+        if (count == 0)
+            return;
+
+        std::vector<std::uint64_t> entryHashes(count);
+        std::vector<std::size_t> byHash(count);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            entryHashes[i] = static_cast<std::uint64_t>(mHasher(entries[i].first));
+            byHash[i] = i;
+        }
+        std::stable_sort(byHash.begin(), byHash.end(), [&entryHashes](std::size_t a, std::size_t b)
+        {
+            return entryHashes[a] < entryHashes[b];
+        });
+
+        // the first key of every hash is placed, the others overflow
+        std::vector<std::size_t> placed;
+        std::vector<std::uint64_t> hashes;
+        placed.reserve(count);
+        hashes.reserve(count);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            const std::size_t entry = byHash[i];
+            if (i > 0 && entryHashes[entry] == entryHashes[byHash[i - 1]])
+            {
+                mOverflow.push_back(std::make_pair(entryHashes[entry], std::move(entries[entry])));
+                continue;
+            }
+            placed.push_back(entry);
+            hashes.push_back(entryHashes[entry]);
+        }
+        mSlotCount = placed.size();
+
+        std::vector<std::size_t> entryAtSlot;
+        for (mSeed = 0; mSeed < MaxSeeds; ++mSeed)
+        {
+            if (placeKeys(hashes, entryAtSlot))
+                break;
+        }
+        if (mSeed == MaxSeeds)
+            throw ConcurrentHashmapException(ConcurrentHashmapException::PerfectHashConstructionFailed);
+
+        mEntries.reserve(mSlotCount);
+        for (std::size_t slotEntry : entryAtSlot)
+            mEntries.push_back(std::move(entries[placed[slotEntry]]));
+    }
+
+    std::size_t size() const
+    {
+        return mEntries.size() + mOverflow.size();
+    }
+
+    bool find(const Key& key) const
+    {
+        return lookup(key) != nullptr;
+    }
+
+    // Throws ConcurrentHashmapException if key not found.
+    Value getCopy(const Key& key) const
+    {
+        return get(key);
+    }
+
+    // Throws ConcurrentHashmapException if key not found.
+    const Value& get(const Key& key) const
+    {
+        if (const Entry* entry = lookup(key))
+            return entry->second;
+        throw ConcurrentHashmapException(ConcurrentHashmapException::KeyNotFound);
+    }
+
+    // Calls fn(key, value) for every entry.
+    template<class Function>
+    void forEach(Function fn) const
+    {
+        for (const Entry& entry : mEntries)
+            fn(entry.first, entry.second);
+        for (const std::pair<std::uint64_t, Entry>& overflow : mOverflow)
+            fn(overflow.second.first, overflow.second.second);
+    }
+
+private:
+    static const std::size_t KeysPerBucket = 3;
+    static const std::size_t FreeSlot = static_cast<std::size_t>(-1);
+    static const std::uint32_t MaxSeeds = 16;
+    // Bounds the search for multi-key buckets; a bucket of a single key always finds a free slot.
+    static const std::uint32_t MaxDisplacementMultipliers = 64;
+
+    struct Displacement
+    {
+        std::uint32_t multiplier;
+        std::uint32_t offset;
+    };
+
+    // the seeded mixes decorrelate the three hash functions derived from one hash value
+    std::size_t bucketOf(std::uint64_t hash) const
+    {
+        return static_cast<std::size_t>(mixHash(hash ^ (FibonacciMultiplier * (mSeed + 1))) % mDisplacements.size());
+    }
+
+    // Slot of a key is (first + multiplier * step + offset) % slot count, first and step depending only on the key.
+    std::pair<std::uint64_t, std::uint64_t> slotFunctions(std::uint64_t hash) const
+    {
+        const std::uint64_t mixed = mixHash(hash + 0xD1B54A32D192ED03ull * (mSeed + 1));
+        return std::make_pair((mixed & 0xFFFFFFFFull) % mSlotCount, (mixed >> 32) % mSlotCount);
+    }
+
+    std::size_t slotOf(std::uint64_t hash, const Displacement& displacement) const
+    {
+        const std::pair<std::uint64_t, std::uint64_t> functions = slotFunctions(hash);
+        return static_cast<std::size_t>(
+            (functions.first + displacement.multiplier * functions.second + displacement.offset) % mSlotCount);
+    }
+
+    const Entry* lookup(const Key& key) const
+    {
+        if (mSlotCount == 0)
+            return nullptr;
+
+        const std::uint64_t hash = static_cast<std::uint64_t>(mHasher(key));
+        const Entry& entry = mEntries[slotOf(hash, mDisplacements[bucketOf(hash)])];
+        if (entry.first == key)
+            return &entry;
+        return mOverflow.empty() ? nullptr : lookupOverflow(key, hash);
+    }
+
+    const Entry* lookupOverflow(const Key& key, std::uint64_t hash) const
+    {
+        typename std::vector<std::pair<std::uint64_t, Entry>>::const_iterator it = std::lower_bound(
+            mOverflow.begin(), mOverflow.end(), hash,
+            [](const std::pair<std::uint64_t, Entry>& overflow, std::uint64_t value)
+            {
+                return overflow.first < value;
+            });
+        for (; it != mOverflow.end() && it->first == hash; ++it)
+        {
+            if (it->second.first == key)
+                return &it->second;
+        }
+        return nullptr;
+    }
+
+    // Finds displacements for the current seed, largest buckets first.
+    // Fills entryAtSlot on success, returns false if some bucket couldn't be placed.
+    bool placeKeys(const std::vector<std::uint64_t>& hashes, std::vector<std::size_t>& entryAtSlot)
+    {
+        const std::size_t count = hashes.size();
+        mDisplacements.assign((count + KeysPerBucket - 1) / KeysPerBucket, Displacement{ 0, 0 });
+
+        std::vector<std::vector<std::size_t>> buckets(mDisplacements.size());
+        for (std::size_t i = 0; i < count; ++i)
+            buckets[bucketOf(hashes[i])].push_back(i);
+
+        std::vector<std::size_t> order(buckets.size());
+        for (std::size_t i = 0; i < order.size(); ++i)
+            order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [&buckets](std::size_t a, std::size_t b)
+        {
+            return buckets[a].size() > buckets[b].size();
+        });
+
+        entryAtSlot.assign(count, FreeSlot);
+        // random order, anchoring on free slots in index order would cluster the remaining ones
+        std::vector<std::size_t> freeSlots(count);
+        for (std::size_t i = 0; i < count; ++i)
+            freeSlots[i] = i;
+        std::shuffle(freeSlots.begin(), freeSlots.end(), std::mt19937_64(mSeed));
+
+        std::vector<std::size_t> slots;
+        for (std::size_t bucket : order)
+        {
+            const std::vector<std::size_t>& keys = buckets[bucket];
+            if (keys.empty())
+                break;
+            if (!placeBucket(keys, hashes, entryAtSlot, freeSlots, mDisplacements[bucket], slots))
+                return false;
+
+            for (std::size_t i = 0; i < keys.size(); ++i)
+                entryAtSlot[slots[i]] = keys[i];
+        }
+        return true;
+    }
+
+    // Searches a displacement that sends all keys of the bucket to distinct free slots, returned in slots.
+    // Only offsets that move the bucket's first key to a free slot are tried; freeSlots is a superset
+    // of the free slots that gets compacted along the way.
+    bool placeBucket(
+        const std::vector<std::size_t>& keys,
+        const std::vector<std::uint64_t>& hashes,
+        const std::vector<std::size_t>& entryAtSlot,
+        std::vector<std::size_t>& freeSlots,
+        Displacement& displacement,
+        std::vector<std::size_t>& slots) const
+    {
+        // keys with the same slot functions collide under every displacement
+        std::vector<std::pair<std::uint64_t, std::uint64_t>> functions;
+        for (std::size_t key : keys)
+            functions.push_back(slotFunctions(hashes[key]));
+        const std::pair<std::uint64_t, std::uint64_t> firstKey = functions.front();
+        std::sort(functions.begin(), functions.end());
+        if (std::adjacent_find(functions.begin(), functions.end()) != functions.end())
+            return false;
+
+        for (displacement.multiplier = 0; displacement.multiplier < MaxDisplacementMultipliers; ++displacement.multiplier)
+        {
+            const std::uint64_t firstSlot = (firstKey.first + displacement.multiplier * firstKey.second) % mSlotCount;
+            std::size_t i = 0;
+            while (i < freeSlots.size())
+            {
+                const std::size_t freeSlot = freeSlots[i];
+                if (entryAtSlot[freeSlot] != FreeSlot)
+                {
+                    freeSlots[i] = freeSlots.back();
+                    freeSlots.pop_back();
+                    continue;
+                }
+                ++i;
+
+                displacement.offset = static_cast<std::uint32_t>((freeSlot + mSlotCount - firstSlot) % mSlotCount);
+                slots.clear();
+                for (std::size_t key : keys)
+                {
+                    const std::size_t slot = slotOf(hashes[key], displacement);
+                    if (entryAtSlot[slot] != FreeSlot || std::find(slots.begin(), slots.end(), slot) != slots.end())
+                        break;
+                    slots.push_back(slot);
+                }
+                if (slots.size() == keys.size())
+                    return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    Hash mHasher;
+    std::uint32_t mSeed;
+    std::size_t mSlotCount;
+    std::vector<Displacement> mDisplacements; // one per bucket
+    std::vector<Entry> mEntries;              // dense, entry i is the key placed in slot i
+    std::vector<std::pair<std::uint64_t, Entry>> mOverflow; // (hash, entry) sorted by hash
+};
+
+template<class Key, class Value, class Hash>
+const std::size_t FrozenHashmap<Key, Value, Hash>::FreeSlot;
+
+
+// Builds an immutable lock-free copy of the map indexed by a minimal perfect hash.
+// The copy is a consistent snapshot only if there are no concurrent writers.
+template<class Key, class Value, class Hash, class LockPolicy, class MapPolicy>
+FrozenHashmap<Key, Value, Hash> freezeToPerfectHash(const ConcurrentHashmap<Key, Value, Hash, LockPolicy, MapPolicy>& hashmap)
+{
+    std::vector<std::pair<Key, Value>> entries;
+    entries.reserve(hashmap.size());
+    hashmap.forEach([&entries](const Key& key, const Value& value)
+    {
+        entries.push_back(std::make_pair(key, value));
+    });
+    return FrozenHashmap<Key, Value, Hash>(std::move(entries), hashmap.hashFunction());
+}
+
+#endif
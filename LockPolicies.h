@@ -0,0 +1,292 @@
+#ifndef LOCK_POLICIES_H
+#define LOCK_POLICIES_H
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Lock policies usable as the LockPolicy parameter of ConcurrentHashmap.
+// Every policy satisfies the Lockable requirements (lock, try_lock, unlock) and is default constructible.
+
+inline void cpuRelax()
+{
+#if defined(_MSC_VER)
+    _mm_pause();
+#elif defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    asm volatile("yield");
+#endif
+}
+
+// Exponential backoff used by the spinning locks. Once the backoff saturates the thread yields,
+// so that a preempted lock holder gets a chance to run on oversubscribed machines.
+class Backoff
+{
+public:
+    Backoff() : mPauses(1) {}
+
+    void pause()
+    {
+        if (mPauses > MaxPauses)
+        {
+            std::this_thread::yield();
+            return;
+        }
+
+        for (std::size_t i = 0; i < mPauses; ++i)
+            cpuRelax();
+        mPauses *= 2;
+    }
+
+private:
+    static const std::size_t MaxPauses = 64;
+
+    std::size_t mPauses;
+};
+
+
+// Test-and-test-and-set spinlock with exponential backoff.
+// Cheapest option for very short critical sections with low to moderate contention.
+class SpinLock
+{
+public:
+    SpinLock() : mLocked(false) {}
+
+    void lock()
+    {
+        Backoff backoff;
+        while (mLocked.exchange(true, std::memory_order_acquire))
+        {
+            do
+                backoff.pause();
+            while (mLocked.load(std::memory_order_relaxed));
+        }
+    }
+
+    bool try_lock()
+    {
+        return !mLocked.load(std::memory_order_relaxed) && !mLocked.exchange(true, std::memory_order_acquire);
+    }
+
+    void unlock()
+    {
+        mLocked.store(false, std::memory_order_release);
+    }
+
+private:
+    // noncopyable
+    SpinLock(const SpinLock&) = delete;
+    SpinLock& operator=(const SpinLock&) = delete;
+
+    std::atomic<bool> mLocked;
+};
+
+
+// FIFO-fair ticket lock. Fairness has a price on oversubscribed machines: a preempted waiter
+// holds up everybody queued behind it.
+class TicketLock
+{
+public:
+    TicketLock() : mNext(0), mServing(0) {}
+
+    void lock()
+    {
+        const std::size_t ticket = mNext.fetch_add(1, std::memory_order_relaxed);
+        Backoff backoff;
+        while (mServing.load(std::memory_order_acquire) != ticket)
+            backoff.pause();
+    }
+
+    bool try_lock()
+    {
+        std::size_t serving = mServing.load(std::memory_order_acquire);
+        return mNext.compare_exchange_strong(serving, serving + 1, std::memory_order_acquire, std::memory_order_relaxed);
+    }
+
+    void unlock()
+    {
+        // Only the holder advances mServing, so a plain load-then-store is enough.
+        mServing.store(mServing.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+private:
+    // noncopyable
+    TicketLock(const TicketLock&) = delete;
+    TicketLock& operator=(const TicketLock&) = delete;
+
+    std::atomic<std::size_t> mNext;
+    std::atomic<std::size_t> mServing;
+};
+
+
+// MCS queue lock. Every waiter spins on its own queue node, so the lock's cache line
+// is touched only once per acquisition regardless of the number of waiters.
+// Queue nodes come from a per-thread pool, which allows a thread to hold several MCS locks at once.
+class McsLock
+{
+    struct QueueNode
+    {
+        std::atomic<QueueNode*> next;
+        std::atomic<bool> locked;
+        char padding[64 - sizeof(std::atomic<QueueNode*>) - sizeof(std::atomic<bool>)];
+    };
+
+public:
+    McsLock() : mTail(nullptr), mOwner(nullptr) {}
+
+    void lock()
+    {
+        QueueNode* node = acquireNode();
+        QueueNode* pred = mTail.exchange(node, std::memory_order_acq_rel);
+        if (pred)
+        {
+            pred->next.store(node, std::memory_order_release);
+            Backoff backoff;
+            while (node->locked.load(std::memory_order_acquire))
+                backoff.pause();
+        }
+        mOwner = node;
+    }
+
+    bool try_lock()
+    {
+        QueueNode* node = acquireNode();
+        QueueNode* expected = nullptr;
+        if (!mTail.compare_exchange_strong(expected, node, std::memory_order_acq_rel, std::memory_order_relaxed))
+        {
+            releaseNode(node);
+            return false;
+        }
+        mOwner = node;
+        return true;
+    }
+
+    void unlock()
+    {
+        QueueNode* node = mOwner;
+        QueueNode* succ = node->next.load(std::memory_order_acquire);
+        if (!succ)
+        {
+            QueueNode* expected = node;
+            if (mTail.compare_exchange_strong(expected, nullptr, std::memory_order_acq_rel, std::memory_order_relaxed))
+            {
+                releaseNode(node);
+                return;
+            }
+
+            // A successor has swapped itself into the tail but hasn't linked to us yet.
+            Backoff backoff;
+            while (!(succ = node->next.load(std::memory_order_acquire)))
+                backoff.pause();
+        }
+        succ->locked.store(false, std::memory_order_release);
+        releaseNode(node);
+    }
+
+private:
+    // noncopyable
+    McsLock(const McsLock&) = delete;
+    McsLock& operator=(const McsLock&) = delete;
+
+    struct NodePool
+    {
+        std::vector<QueueNode*> nodes;
+
+        ~NodePool()
+        {
+            for (QueueNode* node : nodes)
+                delete node;
+        }
+    };
+
+    static NodePool& nodePool()
+    {
+        thread_local NodePool pool;
+        return pool;
+    }
+
+    static QueueNode* acquireNode()
+    {
+        NodePool& pool = nodePool();
+        QueueNode* node;
+        if (pool.nodes.empty())
+        {
+            node = new QueueNode;
+        }
+        else
+        {
+            node = pool.nodes.back();
+            pool.nodes.pop_back();
+        }
+        node->next.store(nullptr, std::memory_order_relaxed);
+        node->locked.store(true, std::memory_order_relaxed);
+        return node;
+    }
+
+    static void releaseNode(QueueNode* node)
+    {
+        nodePool().nodes.push_back(node);
+    }
+
+private:
+    std::atomic<QueueNode*> mTail;
+    QueueNode* mOwner; // accessed only by the lock holder
+};
+
+
+// Spin-then-park lock: spins briefly with try_lock and falls back to blocking on std::mutex,
+// so short critical sections avoid the futex sleep while long waits don't burn CPU.
+class AdaptiveLock
+{
+public:
+    AdaptiveLock() {}
+
+    void lock()
+    {
+        for (std::size_t i = 0; i < SpinCount; ++i)
+        {
+            if (mMutex.try_lock())
+                return;
+            cpuRelax();
+        }
+        mMutex.lock();
+    }
+
+    bool try_lock()
+    {
+        return mMutex.try_lock();
+    }
+
+    void unlock()
+    {
+        mMutex.unlock();
+    }
+
+private:
+    // noncopyable
+    AdaptiveLock(const AdaptiveLock&) = delete;
+    AdaptiveLock& operator=(const AdaptiveLock&) = delete;
+
+    static const std::size_t SpinCount = 100;
+
+    std::mutex mMutex;
+};
+
+
+// Lock that does nothing, for maps that are only ever accessed by a single thread.
+class NullLock
+{
+public:
+    void lock() {}
+    bool try_lock() { return true; }
+    void unlock() {}
+};
+
+#endif
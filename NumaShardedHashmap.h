@@ -0,0 +1,250 @@
+#ifndef NUMA_SHARDED_HASH_MAP_H
+#define NUMA_SHARDED_HASH_MAP_H
+
+#include "ConcurrentHashMap.h"
+
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+// NUMA nodes of the machine and their CPUs as reported by sysfs.
+// Falls back to a single node holding all CPUs where that information isn't available.
+class NumaTopology
+{
+public:
+    NumaTopology()
+    {
+        std::ifstream online("/sys/devices/system/node/online");
+        std::string list;
+        if (online >> list)
+        {
+            for (int node : parseList(list))
+            {
+                std::ifstream cpuList("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+                std::string cpus;
+                if (cpuList >> cpus)
+                {
+                    mNodeIds.push_back(node);
+                    mNodeCpus.push_back(parseList(cpus));
+                }
+            }
+        }
+
+        if (mNodeIds.empty())
+        {
+            mNodeIds.push_back(0);
+            mNodeCpus.push_back(std::vector<int>());
+        }
+    }
+
+    std::size_t nodeCount() const
+    {
+        return mNodeIds.size();
+    }
+
+    // Restricts the calling thread to the CPUs of the node and makes the node preferred for the memory
+    // the thread allocates and touches first from now on. Returns false if the system doesn't support it.
+    bool bindCurrentThread(std::size_t node) const
+    {
+#if defined(__linux__)
+        const std::vector<int>& cpus = mNodeCpus[node];
+        if (cpus.empty())
+            return false;
+
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        for (int cpu : cpus)
+            CPU_SET(cpu, &cpuSet);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) != 0)
+            return false;
+
+        const std::size_t bitsPerWord = sizeof(unsigned long) * 8;
+        const int nodeId = mNodeIds[node];
+        std::vector<unsigned long> nodeMask(nodeId / bitsPerWord + 1, 0);
+        nodeMask[nodeId / bitsPerWord] |= 1ul << (nodeId % bitsPerWord);
+        // the kernel expects one more than the number of bits in the mask
+        return syscall(SYS_set_mempolicy, MPOL_PREFERRED, nodeMask.data(), nodeMask.size() * bitsPerWord + 1) == 0;
+#else
+        (void)node;
+        return false;
+#endif
+    }
+
+private:
+    // Parses sysfs lists such as "0-3,8,10-11".
+    static std::vector<int> parseList(const std::string& list)
+    {
+        std::vector<int> result;
+        std::size_t pos = 0;
+        while (pos < list.size())
+        {
+            std::size_t end = list.find(',', pos);
+            if (end == std::string::npos)
+                end = list.size();
+
+            const std::string range = list.substr(pos, end - pos);
+            const std::size_t dash = range.find('-');
+            const int first = std::stoi(range.substr(0, dash));
+            const int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for (int i = first; i <= last; ++i)
+                result.push_back(i);
+
+            pos = end + 1;
+        }
+        return result;
+    }
+
+private:
+    std::vector<int> mNodeIds;
+    std::vector<std::vector<int>> mNodeCpus;
+};
+
+
+// Hashmap partitioned into one ConcurrentHashmap per NUMA node. Each shard is constructed by a thread
+// bound to its node, so the shard's bucket table and stripe locks are placed in node-local memory.
+// Nodes of the shard lists are allocated by the inserting threads; threads that call bindCurrentThreadToShard
+// and work mostly on keys of that shard (see shardOf) keep those allocations local as well.
+template<class Key, class Value, class Hash = std::hash<Key>, class LockPolicy = std::mutex>
+class NumaShardedHashmap
+{
+public:
+    typedef ConcurrentHashmap<Key, Value, Hash, LockPolicy> Shard;
+    typedef typename Shard::LockedValue LockedValue;
+
+    // Capacity and concurrency level are divided between the shards. shardCount 0 means one shard per node;
+    // more shards than nodes simulate a larger topology, shard i being placed on node i % nodeCount.
+    explicit NumaShardedHashmap(
+        std::size_t capacity,
+        std::size_t concurrencyLevel = ConcurrencyLevelDefault,
+        const Hash& hasher = Hash(),
+        std::size_t shardCount = 0) :
+        mHasher(hasher)
+    {
+        if (capacity == 0)
+            throw ConcurrentHashmapException(ConcurrentHashmapException::InvalidCapacity);
+        if (concurrencyLevel == 0)
+            throw ConcurrentHashmapException(ConcurrentHashmapException::InvalidConcurrencyLevel);
+
+        if (shardCount == 0)
+            shardCount = mTopology.nodeCount();
+
+        const std::size_t shardCapacity = (capacity + shardCount - 1) / shardCount;
+        const std::size_t shardConcurrencyLevel = (concurrencyLevel + shardCount - 1) / shardCount;
+        for (std::size_t shard = 0; shard < shardCount; ++shard)
+        {
+            std::exception_ptr error;
+            std::thread([&, shard]
+            {
+                mTopology.bindCurrentThread(nodeOfShard(shard));
+                try
+                {
+                    mShards.push_back(std::unique_ptr<Shard>(new Shard(shardCapacity, shardConcurrencyLevel, hasher)));
+                }
+                catch (...)
+                {
+                    error = std::current_exception();
+                }
+            }).join();
+
+            if (error)
+                std::rethrow_exception(error);
+        }
+    }
+
+    std::size_t capacity() const
+    {
+        std::size_t result = 0;
+        for (const std::unique_ptr<Shard>& shard : mShards)
+            result += shard->capacity();
+        return result;
+    }
+
+    std::size_t size() const
+    {
+        std::size_t result = 0;
+        for (const std::unique_ptr<Shard>& shard : mShards)
+            result += shard->size();
+        return result;
+    }
+
+    std::size_t shardCount() const
+    {
+        return mShards.size();
+    }
+
+    // Shard that holds the key
+    std::size_t shardOf(const Key& key) const
+    {
+        // high bits of the mixed hash, independent of the bucket index taken inside the shard
+        const std::uint64_t hash = static_cast<std::uint64_t>(mHasher(key));
+        return static_cast<std::size_t>(fibonacciHash(hash)) % mShards.size();
+    }
+
+    // NUMA node the shard's memory was allocated on
+    std::size_t nodeOfShard(std::size_t shard) const
+    {
+        return shard % mTopology.nodeCount();
+    }
+
+    // Affinity hint: moves the calling thread to the CPUs of the shard's node and makes its allocations prefer
+    // that node. Returns false if the system doesn't support it; the map works the same either way.
+    bool bindCurrentThreadToShard(std::size_t shard) const
+    {
+        return mTopology.bindCurrentThread(nodeOfShard(shard));
+    }
+
+    bool find(const Key& key) const
+    {
+        return shardFor(key).find(key);
+    }
+
+    Value getCopy(const Key& key) const
+    {
+        return shardFor(key).getCopy(key);
+    }
+
+    LockedValue get(const Key& key) const
+    {
+        return shardFor(key).get(key);
+    }
+
+    void insert(const Key& key, const Value& value)
+    {
+        shardFor(key).insert(key, value);
+    }
+
+    void erase(const Key& key)
+    {
+        shardFor(key).erase(key);
+    }
+
+private:
+    // noncopyable
+    NumaShardedHashmap(const NumaShardedHashmap&) = delete;
+    NumaShardedHashmap& operator=(const NumaShardedHashmap&) = delete;
+
+    Shard& shardFor(const Key& key) const
+    {
+        return *mShards[shardOf(key)];
+    }
+
+private:
+    const NumaTopology mTopology;
+    const Hash mHasher;
+    std::vector<std::unique_ptr<Shard>> mShards;
+};
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef VERSIONED_MAP_HANDLE_H
+#define VERSIONED_MAP_HANDLE_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+
+// Holds the current version of a map that is rebuilt from scratch from time to time, e.g. a reference table.
+// A background thread builds the new map privately (bulkLoad, freezeToPerfectHash...) and publishes it in one
+// atomic step; readers never see a half-built map. Readers register on one of two counters, selected by the
+// low bit of the publication index: publish swaps the map, flips the index and waits for the readers counted
+// before the flip, the only ones that may still be using the old map, then hands the old map back to the
+// publishing thread. Readers never wait for publishers.
+template<class Map>
+class VersionedMapHandle
+{
+    static const std::size_t CacheLineSize = 64;
+
+    struct ReaderCount
+    {
+        ReaderCount() : count(0) {}
+
+        std::atomic<std::size_t> count;
+        char padding[CacheLineSize - sizeof(std::atomic<std::size_t>)];
+    };
+
+    class ReadGuard;
+
+public:
+    explicit VersionedMapHandle(std::unique_ptr<Map> map) :
+        mMap(map.release()),
+        mIndex(0)
+    {
+    }
+
+    ~VersionedMapHandle()
+    {
+        delete mMap.load(std::memory_order_relaxed);
+    }
+
+    // Calls fn(const Map&) on the current map and returns its result. The map stays alive until fn returns,
+    // even if a newer one is published meanwhile, so fn should be short: publish waits for it.
+    template<class Function>
+    auto read(Function fn) const -> decltype(fn(std::declval<const Map&>()))
+    {
+        ReadGuard guard(*this);
+        return fn(*mMap.load(std::memory_order_acquire));
+    }
+
+    // Makes map the current one and returns the previous one once no reader uses it anymore, so that
+    // the caller frees it off the readers' path. Publishers are serialized.
+    std::unique_ptr<Map> publish(std::unique_ptr<Map> map)
+    {
+        std::lock_guard<std::mutex> lock(mPublishMutex);
+
+        std::unique_ptr<Map> old(mMap.exchange(map.release(), std::memory_order_seq_cst));
+        const std::size_t index = mIndex.load(std::memory_order_relaxed);
+        mIndex.store(index + 1, std::memory_order_seq_cst);
+
+        // readers counted on the new index load the map after the exchange
+        const ReaderCount& readers = mReaders[index & 1];
+        while (readers.count.load(std::memory_order_seq_cst) != 0)
+            std::this_thread::yield();
+        return old;
+    }
+
+    // Number of publications so far
+    std::size_t version() const
+    {
+        return mIndex.load(std::memory_order_acquire);
+    }
+
+private:
+    // noncopyable
+    VersionedMapHandle(const VersionedMapHandle&) = delete;
+    VersionedMapHandle& operator=(const VersionedMapHandle&) = delete;
+
+private:
+    std::atomic<Map*> mMap;
+    std::atomic<std::size_t> mIndex;      // publication count, the low bit selects the readers' counter
+    mutable ReaderCount mReaders[2];
+    std::mutex mPublishMutex;
+};
+
+// Counts the reader on the counter of the current index. If the index flips between reading it and
+// counting, the publisher may have missed the reader, which then retries on the new index.
+template<class Map>
+class VersionedMapHandle<Map>::ReadGuard
+{
+public:
+    explicit ReadGuard(const VersionedMapHandle& handle)
+    {
+        while (true)
+        {
+            const std::size_t index = handle.mIndex.load(std::memory_order_acquire);
+            mReaders = &handle.mReaders[index & 1];
+            mReaders->count.fetch_add(1, std::memory_order_seq_cst);
+            if (handle.mIndex.load(std::memory_order_seq_cst) == index)
+                return;
+            mReaders->count.fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    ~ReadGuard()
+    {
+        mReaders->count.fetch_sub(1, std::memory_order_release);
+    }
+
+private:
+    // noncopyable
+    ReadGuard(const ReadGuard&) = delete;
+    ReadGuard& operator=(const ReadGuard&) = delete;
+
+    ReaderCount* mReaders;
+};
+
+#endif
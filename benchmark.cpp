@@ -0,0 +1,1252 @@
+#include "ConcurrentCounterMap.h"
+#include "ConcurrentFlatHashmap.h"
+#include "ConcurrentHashMap.h"
+#include "ConcurrentHashset.h"
+#include "ConcurrentMultimap.h"
+#include "ConcurrentOrderedMap.h"
+#include "ConcurrentUnrolledHashmap.h"
+#include "DelegatedHashmap.h"
+#include "FrozenHashmap.h"
+#include "LockPolicies.h"
+#include "NumaShardedHashmap.h"
+#include "VersionedMapHandle.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+namespace
+{
+    const std::vector<int> DefaultThreadCounts = { 1, 2, 4, 8 };
+    std::vector<int> ThreadCounts = DefaultThreadCounts;
+
+    // xorshift64*, good enough to spread keys and cheap enough not to dominate the measurement
+    class Random
+    {
+    public:
+        explicit Random(std::uint64_t seed) : mState(seed * 0x9E3779B97F4A7C15ull + 1) {}
+
+        std::uint64_t next()
+        {
+            mState ^= mState >> 12;
+            mState ^= mState << 25;
+            mState ^= mState >> 27;
+            return mState * 0x2545F4914F6CDD1Dull;
+        }
+
+    private:
+        std::uint64_t mState;
+    };
+
+    // Draws ranks 0..n-1 with P(rank) proportional to 1 / (rank + 1)^exponent.
+    class Zipf
+    {
+    public:
+        Zipf(std::size_t n, double exponent) : mCdf(n)
+        {
+            double sum = 0;
+            for (std::size_t i = 0; i < n; ++i)
+                mCdf[i] = sum += 1 / std::pow(static_cast<double>(i + 1), exponent);
+            for (double& p : mCdf)
+                p /= sum;
+        }
+
+        std::size_t next(Random& random) const
+        {
+            const double u = static_cast<double>(random.next() >> 11) / static_cast<double>(1ull << 53);
+            return std::min(mCdf.size() - 1, static_cast<std::size_t>(std::lower_bound(mCdf.begin(), mCdf.end(), u) - mCdf.begin()));
+        }
+
+    private:
+        std::vector<double> mCdf;
+    };
+
+    // Runs body(threadIndex) on threadCount threads started together, returns wall time in seconds.
+    template<class Function>
+    double runThreads(int threadCount, Function body)
+    {
+        std::atomic<bool> start(false);
+        std::vector<std::thread> threads;
+        for (int i = 0; i < threadCount; ++i)
+        {
+            threads.push_back(std::thread([&start, &body, i]
+            {
+                while (!start.load(std::memory_order_acquire))
+                    std::this_thread::yield();
+                body(i);
+            }));
+        }
+
+        const std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        start.store(true, std::memory_order_release);
+        for (std::thread& t : threads)
+            t.join();
+        const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+        return std::chrono::duration<double>(end - begin).count();
+    }
+
+    void printHeader(const char* title, const std::vector<int>& threadCounts = DefaultThreadCounts, const char* unit = "Mops/s")
+    {
+        ThreadCounts = threadCounts;
+        std::printf("\n%s\n%-14s %-14s", title, "variant", "parameter");
+        for (int threads : ThreadCounts)
+            std::printf(" %8dT", threads);
+        std::printf("    (%s)\n", unit);
+    }
+
+    template<class Function>
+    void printRow(const char* variant, const char* parameter, Function measureMops)
+    {
+        std::printf("%-14s %-14s", variant, parameter);
+        for (int threads : ThreadCounts)
+            std::printf(" %9.2f", measureMops(threads));
+        std::printf("\n");
+        std::fflush(stdout);
+    }
+
+    // 80% find / 20% insert on uniformly random keys
+    template<class LockPolicy>
+    double measureLockPolicy(int threadCount, std::size_t concurrencyLevel)
+    {
+        const int opsPerThread = 100000;
+        const int keyRange = 100000;
+        ConcurrentHashmap<int, int, std::hash<int>, LockPolicy> hashmap(keyRange, concurrencyLevel);
+
+        const double seconds = runThreads(threadCount, [&hashmap](int threadIndex)
+        {
+            Random random(threadIndex);
+            for (int i = 0; i < opsPerThread; ++i)
+            {
+                const std::uint64_t r = random.next();
+                const int key = static_cast<int>((r >> 8) % keyRange);
+                if (r % 5)
+                    hashmap.find(key);
+                else
+                    hashmap.insert(key, i);
+            }
+        });
+        return threadCount * opsPerThread / seconds / 1e6;
+    }
+
+    template<class LockPolicy>
+    void benchmarkLockPolicy(const char* name)
+    {
+        const std::size_t concurrencyLevels[] = { 1, 8, 1024 };
+        for (std::size_t level : concurrencyLevels)
+        {
+            char parameter[32];
+            std::snprintf(parameter, sizeof(parameter), "stripes=%zu", level);
+            printRow(name, parameter, [level](int threads) { return measureLockPolicy<LockPolicy>(threads, level); });
+        }
+    }
+
+    void benchmarkLockPolicies()
+    {
+        printHeader("Stripe lock policies, 80% find / 20% insert");
+        benchmarkLockPolicy<std::mutex>("std::mutex");
+        benchmarkLockPolicy<SpinLock>("SpinLock");
+        benchmarkLockPolicy<TicketLock>("TicketLock");
+        benchmarkLockPolicy<McsLock>("McsLock");
+        benchmarkLockPolicy<AdaptiveLock>("AdaptiveLock");
+    }
+
+    // uniformly random inserts and erases
+    template<class LockPolicy>
+    double measureRandomWrites(int threadCount, std::size_t concurrencyLevel)
+    {
+        const int opsPerThread = 100000;
+        const int keyRange = 1 << 20;
+        ConcurrentHashmap<int, int, std::hash<int>, LockPolicy> hashmap(keyRange, concurrencyLevel);
+
+        const double seconds = runThreads(threadCount, [&hashmap](int threadIndex)
+        {
+            Random random(threadIndex);
+            for (int i = 0; i < opsPerThread; ++i)
+            {
+                const std::uint64_t r = random.next();
+                const int key = static_cast<int>((r >> 8) % keyRange);
+                if (r & 1)
+                    hashmap.insert(key, i);
+                else
+                    hashmap.erase(key);
+            }
+        });
+        return threadCount * opsPerThread / seconds / 1e6;
+    }
+
+    void benchmarkBucketBitLock()
+    {
+        printHeader("Per-bucket bit lock vs lock stripes, uniform random writes");
+        const std::size_t concurrencyLevels[] = { 16, 1024 };
+        for (std::size_t level : concurrencyLevels)
+        {
+            char parameter[32];
+            std::snprintf(parameter, sizeof(parameter), "stripes=%zu", level);
+            printRow("std::mutex", parameter, [level](int threads) { return measureRandomWrites<std::mutex>(threads, level); });
+            printRow("SpinLock", parameter, [level](int threads) { return measureRandomWrites<SpinLock>(threads, level); });
+        }
+        printRow("BucketBitLock", "per bucket", [](int threads) { return measureRandomWrites<BucketBitLock>(threads, 1); });
+    }
+
+    // std::mutex that counts the acquisitions which found it already held
+    class CountingMutex
+    {
+    public:
+        static std::atomic<std::size_t> acquisitions;
+        static std::atomic<std::size_t> contended;
+
+        void lock()
+        {
+            acquisitions.fetch_add(1, std::memory_order_relaxed);
+            if (!mMutex.try_lock())
+            {
+                contended.fetch_add(1, std::memory_order_relaxed);
+                mMutex.lock();
+            }
+        }
+
+        bool try_lock() { return mMutex.try_lock(); }
+        void unlock() { mMutex.unlock(); }
+
+    private:
+        std::mutex mMutex;
+    };
+
+    std::atomic<std::size_t> CountingMutex::acquisitions(0);
+    std::atomic<std::size_t> CountingMutex::contended(0);
+
+    // Every thread ingests its own block of sequential keys, like createInserter in the tests.
+    // Identity std::hash<int> maps the blocks to runs of adjacent buckets.
+    double measureSequentialIngest(int threadCount, StripeMapping mapping)
+    {
+        const int keysPerThread = 50000;
+        ConcurrentHashmap<int, int, std::hash<int>, CountingMutex> hashmap(1 << 20, 16, std::hash<int>(), mapping);
+
+        const double seconds = runThreads(threadCount, [&hashmap](int threadIndex)
+        {
+            for (int i = 0; i < keysPerThread; ++i)
+                hashmap.insert(threadIndex * keysPerThread + i, i);
+        });
+        return threadCount * keysPerThread / seconds / 1e6;
+    }
+
+    void benchmarkStripeMapping()
+    {
+        printHeader("Stripe mapping, sequential key ingest, 16 stripes");
+        const StripeMapping mappings[] = { StripeMapping::Contiguous, StripeMapping::Interleaved, StripeMapping::Hashed };
+        const char* names[] = { "Contiguous", "Interleaved", "Hashed" };
+        for (std::size_t i = 0; i < 3; ++i)
+        {
+            CountingMutex::acquisitions = 0;
+            CountingMutex::contended = 0;
+            const StripeMapping mapping = mappings[i];
+            printRow(names[i], "Mops/s", [mapping](int threads) { return measureSequentialIngest(threads, mapping); });
+            std::printf("%-14s %-14s %9.2f%% of acquisitions over all runs\n", names[i], "contended",
+                100.0 * CountingMutex::contended / CountingMutex::acquisitions);
+        }
+    }
+
+    // 50% find / 50% insert on random keys against a map created with only 2 stripes
+    double measureStripeSplitting(int threadCount, std::size_t splitThreshold, std::size_t& stripeCount)
+    {
+        const int opsPerThread = 200000;
+        const int keyRange = 1 << 16;
+        ConcurrentHashmap<int, int> hashmap(keyRange, 2);
+        hashmap.setStripeSplitThreshold(splitThreshold);
+
+        const double seconds = runThreads(threadCount, [&hashmap](int threadIndex)
+        {
+            Random random(threadIndex);
+            for (int i = 0; i < opsPerThread; ++i)
+            {
+                const std::uint64_t r = random.next();
+                const int key = static_cast<int>((r >> 8) % keyRange);
+                if (r & 1)
+                    hashmap.find(key);
+                else
+                    hashmap.insert(key, i);
+            }
+        });
+        stripeCount = hashmap.stripeCount();
+        return threadCount * opsPerThread / seconds / 1e6;
+    }
+
+    void benchmarkStripeSplitting()
+    {
+        printHeader("Adaptive stripe splitting, starting from 2 stripes, 50% find / 50% insert");
+        const std::size_t thresholds[] = { 0, 64, 1024 };
+        for (std::size_t threshold : thresholds)
+        {
+            char parameter[32];
+            std::snprintf(parameter, sizeof(parameter), "threshold=%zu", threshold);
+            std::size_t stripeCount = 0;
+            printRow(threshold ? "adaptive" : "fixed", parameter, [threshold, &stripeCount](int threads)
+            {
+                return measureStripeSplitting(threads, threshold, stripeCount);
+            });
+            std::printf("%-14s %-14s %9zu stripes at the end of the last run\n", "", "", stripeCount);
+        }
+    }
+
+    // Each thread binds itself to a shard and runs 80% find / 20% insert either on keys of that shard
+    // or on keys of the next shard, which lives on another node when there are several.
+    double measureNumaAccess(NumaShardedHashmap<int, int>& hashmap, const std::vector<std::vector<int>>& shardKeys,
+        int threadCount, bool remote)
+    {
+        const int opsPerThread = 200000;
+        const double seconds = runThreads(threadCount, [&](int threadIndex)
+        {
+            const std::size_t shard = threadIndex % hashmap.shardCount();
+            hashmap.bindCurrentThreadToShard(shard);
+            const std::vector<int>& keys = shardKeys[remote ? (shard + 1) % hashmap.shardCount() : shard];
+
+            Random random(threadIndex);
+            for (int i = 0; i < opsPerThread; ++i)
+            {
+                const std::uint64_t r = random.next();
+                const int key = keys[(r >> 8) % keys.size()];
+                if (r % 5)
+                    hashmap.find(key);
+                else
+                    hashmap.insert(key, i);
+            }
+        });
+        return threadCount * opsPerThread / seconds / 1e6;
+    }
+
+    void benchmarkNuma()
+    {
+        const std::size_t nodeCount = NumaTopology().nodeCount();
+        const std::size_t shardCount = std::max<std::size_t>(nodeCount, 2);
+        const int keysPerShard = 1 << 18;
+        NumaShardedHashmap<int, int> hashmap(shardCount * keysPerShard, 16 * shardCount, std::hash<int>(), shardCount);
+
+        std::vector<std::vector<int>> shardKeys(shardCount);
+        for (int key = 0; key < static_cast<int>(shardCount) * keysPerShard; ++key)
+            shardKeys[hashmap.shardOf(key)].push_back(key);
+
+        char title[128];
+        std::snprintf(title, sizeof(title), "NUMA sharded map, %zu node(s), %zu shards, 80%% find / 20%% insert",
+            nodeCount, shardCount);
+        printHeader(title);
+        printRow("local shard", "", [&](int threads) { return measureNumaAccess(hashmap, shardKeys, threads, false); });
+        printRow("remote shard", "", [&](int threads) { return measureNumaAccess(hashmap, shardKeys, threads, true); });
+    }
+
+    // 50% insert / 50% erase, 90% of them on 16 hot keys
+    double measureSkewedWrites(int threadCount, bool combining)
+    {
+        const int opsPerThread = 200000;
+        const int keyRange = 1 << 16;
+        const int hotKeys = 16;
+        ConcurrentHashmap<int, int> hashmap(keyRange);
+
+        const double seconds = runThreads(threadCount, [&hashmap, combining](int threadIndex)
+        {
+            Random random(threadIndex);
+            for (int i = 0; i < opsPerThread; ++i)
+            {
+                const std::uint64_t r = random.next();
+                const int key = static_cast<int>((r >> 8) % (r % 10 ? hotKeys : keyRange));
+                const bool insert = (r >> 4) & 1;
+                if (combining)
+                {
+                    if (insert)
+                        hashmap.combiningInsert(key, i);
+                    else
+                        hashmap.combiningErase(key);
+                }
+                else
+                {
+                    if (insert)
+                        hashmap.insert(key, i);
+                    else
+                        hashmap.erase(key);
+                }
+            }
+        });
+        return threadCount * opsPerThread / seconds / 1e6;
+    }
+
+    void benchmarkFlatCombining()
+    {
+        printHeader("Flat combining, skewed writes (90% on 16 hot keys)");
+        printRow("locking", "", [](int threads) { return measureSkewedWrites(threads, false); });
+        printRow("combining", "", [](int threads) { return measureSkewedWrites(threads, true); });
+    }
+
+    // random inserts; delegated writes count once every shard has executed them
+    double measureIngest(int threadCount, bool delegated)
+    {
+        const int opsPerThread = 200000;
+        const int keyRange = 1 << 20;
+        if (delegated)
+        {
+            DelegatedHashmap<int, int> hashmap(keyRange, 4);
+            const double seconds = runThreads(threadCount, [&hashmap](int threadIndex)
+            {
+                Random random(threadIndex);
+                for (int i = 0; i < opsPerThread; ++i)
+                    hashmap.insert(static_cast<int>(random.next() % keyRange), i);
+                hashmap.flush().wait();
+            });
+            return threadCount * opsPerThread / seconds / 1e6;
+        }
+
+        ConcurrentHashmap<int, int> hashmap(keyRange);
+        const double seconds = runThreads(threadCount, [&hashmap](int threadIndex)
+        {
+            Random random(threadIndex);
+            for (int i = 0; i < opsPerThread; ++i)
+                hashmap.insert(static_cast<int>(random.next() % keyRange), i);
+        });
+        return threadCount * opsPerThread / seconds / 1e6;
+    }
+
+    void benchmarkDelegation()
+    {
+        printHeader("Shared-nothing delegation (4 shard owners) vs striped locks, random inserts");
+        printRow("striped", "", [](int threads) { return measureIngest(threads, false); });
+        printRow("delegated", "4 shards", [](int threads) { return measureIngest(threads, true); });
+    }
+
+    // random inserts, directly or through a BulkWriter per thread
+    double measureBulkWriter(int threadCount, bool buffered)
+    {
+        const int totalInserts = 1 << 21;
+        const int opsPerThread = totalInserts / threadCount;
+        ConcurrentHashmap<int, int> hashmap(totalInserts);
+
+        const double seconds = runThreads(threadCount, [&hashmap, buffered, opsPerThread](int threadIndex)
+        {
+            Random random(threadIndex);
+            if (buffered)
+            {
+                ConcurrentHashmap<int, int>::BulkWriter writer(hashmap);
+                for (int i = 0; i < opsPerThread; ++i)
+                    writer.insert(static_cast<int>(random.next() % totalInserts), i);
+            }
+            else
+            {
+                for (int i = 0; i < opsPerThread; ++i)
+                    hashmap.insert(static_cast<int>(random.next() % totalInserts), i);
+            }
+        });
+        return threadCount * opsPerThread / seconds / 1e6;
+    }
+
+    void benchmarkBulkWriter()
+    {
+        printHeader("Bulk ingest, 2M random inserts split between threads", { 1, 4, 16, 64 });
+        printRow("insert", "", [](int threads) { return measureBulkWriter(threads, false); });
+        printRow("BulkWriter", "batch=256", [](int threads) { return measureBulkWriter(threads, true); });
+    }
+
+    // loads 2M random pairs into an empty map, with per-thread inserts or a single bulkLoad call
+    double measureBulkLoad(int threadCount, bool bulk)
+    {
+        const int totalInserts = 1 << 21;
+        Random random(0);
+        std::vector<std::pair<int, int>> values;
+        for (int i = 0; i < totalInserts; ++i)
+            values.push_back(std::make_pair(static_cast<int>(random.next() % totalInserts), i));
+        ConcurrentHashmap<int, int> hashmap(totalInserts);
+
+        const std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        if (bulk)
+        {
+            hashmap.bulkLoad(values.begin(), values.end(), threadCount);
+        }
+        else
+        {
+            const int opsPerThread = totalInserts / threadCount;
+            runThreads(threadCount, [&hashmap, &values, opsPerThread](int threadIndex)
+            {
+                for (int i = threadIndex * opsPerThread; i < (threadIndex + 1) * opsPerThread; ++i)
+                    hashmap.insert(values[i].first, values[i].second);
+            });
+        }
+        const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+        return totalInserts / std::chrono::duration<double>(end - begin).count() / 1e6;
+    }
+
+    void benchmarkBulkLoad()
+    {
+        printHeader("Initial load of 2M random pairs into an empty map");
+        printRow("insert", "", [](int threads) { return measureBulkLoad(threads, false); });
+        printRow("bulkLoad", "", [](int threads) { return measureBulkLoad(threads, true); });
+    }
+
+    // random successful lookups in a read-only table of 1M keys
+    template<class Hashmap>
+    double measureLookups(const Hashmap& hashmap, int threadCount, int keyRange)
+    {
+        const int opsPerThread = 1000000;
+        std::atomic<int> found(0);
+        const double seconds = runThreads(threadCount, [&hashmap, &found, keyRange](int threadIndex)
+        {
+            Random random(threadIndex);
+            int localFound = 0;
+            for (int i = 0; i < opsPerThread; ++i)
+                localFound += hashmap.find(static_cast<int>(random.next() % keyRange));
+            found += localFound;
+        });
+        return threadCount * opsPerThread / seconds / 1e6;
+    }
+
+    void benchmarkFrozen()
+    {
+        const int keyRange = 1 << 20;
+        ConcurrentHashmap<int, int> hashmap(keyRange);
+        for (int i = 0; i < keyRange; ++i)
+            hashmap.insert(i, i);
+
+        const std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        const FrozenHashmap<int, int> frozen = freezeToPerfectHash(hashmap);
+        const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+        printHeader("Read-only lookups in 1M keys, striped map vs frozen perfect-hash map");
+        printRow("striped", "", [&hashmap, keyRange](int threads) { return measureLookups(hashmap, threads, keyRange); });
+        printRow("frozen", "", [&frozen, keyRange](int threads) { return measureLookups(frozen, threads, keyRange); });
+        std::printf("freezing took %.2f s\n", std::chrono::duration<double>(end - begin).count());
+    }
+
+    // Bytes currently allocated from the heap, 0 where the allocator doesn't tell.
+    std::size_t heapInUse()
+    {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+        const struct mallinfo2 info = mallinfo2();
+        return info.uordblks + info.hblkhd;
+#else
+        return 0;
+#endif
+    }
+
+    // 50% find / 25% insert / 25% erase on 1M uint64 keys, half of them present initially
+    template<class Hashmap>
+    double measureIntegerMap(Hashmap& hashmap, int threadCount)
+    {
+        const int opsPerThread = 1000000 / threadCount;
+        const std::uint64_t keyRange = 1 << 20;
+        const double seconds = runThreads(threadCount, [&hashmap, opsPerThread, keyRange](int threadIndex)
+        {
+            Random random(threadIndex);
+            for (int i = 0; i < opsPerThread; ++i)
+            {
+                const std::uint64_t r = random.next();
+                const std::uint64_t key = (r >> 8) % keyRange;
+                if (r & 1)
+                    hashmap.find(key);
+                else if (r & 2)
+                    hashmap.insert(key, r);
+                else
+                    hashmap.erase(key);
+            }
+        });
+        return threadCount * opsPerThread / seconds / 1e6;
+    }
+
+    template<class Hashmap>
+    void benchmarkIntegerMap(const char* name)
+    {
+        const std::size_t keyRange = 1 << 20;
+        const std::size_t heapBefore = heapInUse();
+        {
+            // filled up to the requested capacity
+            Hashmap hashmap(keyRange);
+            for (std::uint64_t key = 0; key < keyRange; ++key)
+                hashmap.insert(key, key);
+            const std::size_t bytes = heapInUse() - heapBefore;
+            std::printf("%-14s %zu bytes per entry\n", name, bytes / hashmap.size());
+        }
+        printRow(name, "", [](int threads)
+        {
+            Hashmap hashmap(keyRange);
+            for (std::uint64_t key = 0; key < keyRange; key += 2)
+                hashmap.insert(key, key);
+            return measureIntegerMap(hashmap, threads);
+        });
+    }
+
+    void benchmarkFlat()
+    {
+        printHeader("uint64 -> uint64 maps with capacity 1M, 50% find / 25% insert / 25% erase");
+        benchmarkIntegerMap<ConcurrentHashmap<std::uint64_t, std::uint64_t>>("node map");
+        benchmarkIntegerMap<ConcurrentFlatHashmap<std::uint64_t, std::uint64_t>>("flat map");
+    }
+
+    // 95% find / 5% insert on uniformly random keys of a prefilled map
+    template<class MapPolicy>
+    double measureInsertOnly(int threadCount)
+    {
+        const int opsPerThread = 200000;
+        const int keyRange = 100000;
+        ConcurrentHashmap<int, int, std::hash<int>, std::mutex, MapPolicy> hashmap(keyRange);
+        for (int i = 0; i < keyRange; i += 2)
+            hashmap.insert(i, i);
+
+        const double seconds = runThreads(threadCount, [&hashmap](int threadIndex)
+        {
+            Random random(threadIndex);
+            for (int i = 0; i < opsPerThread; ++i)
+            {
+                const std::uint64_t r = random.next();
+                const int key = static_cast<int>((r >> 8) % keyRange);
+                if (r % 20)
+                    hashmap.find(key);
+                else
+                    hashmap.insert(key, i);
+            }
+        });
+        return threadCount * opsPerThread / seconds / 1e6;
+    }
+
+    void benchmarkInsertOnly()
+    {
+        printHeader("Locked vs lock-free reads (InsertOnlyPolicy), 95% find / 5% insert");
+        printRow("default", "", [](int threads) { return measureInsertOnly<DefaultMapPolicy>(threads); });
+        printRow("insert-only", "", [](int threads) { return measureInsertOnly<InsertOnlyPolicy>(threads); });
+    }
+
+    // stands in for the expensive part of a read-modify-write
+    std::uint64_t computeUpdate(std::uint64_t value)
+    {
+        for (int i = 0; i < 200; ++i)
+            value = value * 6364136223846793005ull + 1442695040888963407ull;
+        return value;
+    }
+
+    // 90% getCopy / 10% read-modify-write of random keys out of 1024, over 16 stripes
+    double measureReadModifyWrite(int threadCount, bool optimistic)
+    {
+        const int opsPerThread = 200000;
+        const int keyRange = 1024;
+        ConcurrentHashmap<int, std::uint64_t, std::hash<int>, std::mutex, VersionedPolicy> hashmap(keyRange);
+        for (int i = 0; i < keyRange; ++i)
+            hashmap.insert(i, i);
+
+        const double seconds = runThreads(threadCount, [&hashmap, optimistic](int threadIndex)
+        {
+            Random random(threadIndex);
+            for (int i = 0; i < opsPerThread; ++i)
+            {
+                const std::uint64_t r = random.next();
+                const int key = static_cast<int>((r >> 8) % keyRange);
+                if (r % 10)
+                {
+                    hashmap.getCopy(key);
+                }
+                else if (optimistic)
+                {
+                    std::pair<std::uint64_t, std::uint64_t> read;
+                    do
+                    {
+                        read = hashmap.getVersioned(key);
+                    }
+                    while (!hashmap.compareAndSet(key, read.second, computeUpdate(read.first)));
+                }
+                else
+                {
+                    auto lockedValue = hashmap.get(key);
+                    lockedValue.first = computeUpdate(lockedValue.first);
+                }
+            }
+        });
+        return threadCount * opsPerThread / seconds / 1e6;
+    }
+
+    void benchmarkVersioned()
+    {
+        printHeader("Read-modify-write with a slow update, 90% getCopy / 10% update");
+        printRow("locked", "get()", [](int threads) { return measureReadModifyWrite(threads, false); });
+        printRow("optimistic", "compareAndSet", [](int threads) { return measureReadModifyWrite(threads, true); });
+    }
+
+    // Moves the even keys of a 1M-entry map with 32-character string values to another map, single-threaded.
+    // Returns the moved entries per second, in millions.
+    double measureSplice(int variant)
+    {
+        typedef ConcurrentHashmap<int, std::string> Hashmap;
+        const int keyRange = 1 << 20;
+        Hashmap source(keyRange);
+        Hashmap target(keyRange);
+        for (int i = 0; i < keyRange; ++i)
+            source.insert(i, std::string(32, static_cast<char>('a' + i % 26)));
+
+        const std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        if (variant == 0)
+        {
+            for (int i = 0; i < keyRange; i += 2)
+            {
+                target.insert(i, source.getCopy(i));
+                source.erase(i);
+            }
+        }
+        else if (variant == 1)
+        {
+            for (int i = 0; i < keyRange; i += 2)
+                target.insert(source.extract(i));
+        }
+        else
+        {
+            source.moveAll([](int key, const std::string&) { return key % 2 == 0; }, target);
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        return keyRange / 2 / seconds / 1e6;
+    }
+
+    void benchmarkSplice()
+    {
+        printHeader("Moving 512k of 1M entries with 32-char string values to another map", { 1 });
+        printRow("copy", "getCopy+insert", [](int) { return measureSplice(0); });
+        printRow("node handles", "extract+insert", [](int) { return measureSplice(1); });
+        printRow("moveAll", "", [](int) { return measureSplice(2); });
+    }
+
+    // find through VersionedMapHandle, for measureLookups
+    template<class Map>
+    struct HandleLookups
+    {
+        bool find(int key) const
+        {
+            return handle.read([key](const Map& map) { return map.find(key); });
+        }
+
+        VersionedMapHandle<Map>& handle;
+    };
+
+    std::unique_ptr<FrozenHashmap<int, int>> buildReferenceTable(int keyRange)
+    {
+        std::vector<std::pair<int, int>> entries;
+        for (int i = 0; i < keyRange; ++i)
+            entries.push_back(std::make_pair(i, i));
+        return std::unique_ptr<FrozenHashmap<int, int>>(new FrozenHashmap<int, int>(std::move(entries)));
+    }
+
+    void benchmarkPublish()
+    {
+        typedef FrozenHashmap<int, int> Table;
+        const int keyRange = 1 << 16;
+        std::unique_ptr<Table> direct = buildReferenceTable(keyRange);
+        VersionedMapHandle<Table> handle(buildReferenceTable(keyRange));
+        HandleLookups<Table> lookups{ handle };
+
+        printHeader("Lookups in a 64k-key frozen reference table, direct vs through VersionedMapHandle");
+        printRow("direct", "", [&direct, keyRange](int threads) { return measureLookups(*direct, threads, keyRange); });
+        printRow("handle", "no publishing", [&lookups, keyRange](int threads) { return measureLookups(lookups, threads, keyRange); });
+        printRow("handle", "rebuilt 20/s", [&handle, &lookups, keyRange](int threads)
+        {
+            std::atomic<bool> done(false);
+            std::thread publisher([&handle, &done, keyRange]
+            {
+                while (!done)
+                {
+                    // the old table is freed here, on the publisher
+                    handle.publish(buildReferenceTable(keyRange));
+                    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                }
+            });
+            const double mops = measureLookups(lookups, threads, keyRange);
+            done = true;
+            publisher.join();
+            return mops;
+        });
+    }
+
+    // Resets a 1M-entry map by recreating it (variant 0) or with clear (1), then refills it. Returns the
+    // reset pause in milliseconds, or the refill rate in Mops/s.
+    double measureClear(int variant, bool refill)
+    {
+        typedef ConcurrentHashmap<int, int, std::hash<int>, std::mutex, ClearablePolicy> Hashmap;
+        const int keyRange = 1 << 20;
+        std::unique_ptr<Hashmap> hashmap(new Hashmap(keyRange));
+        for (int i = 0; i < keyRange; ++i)
+            hashmap->insert(i, i);
+
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        if (variant == 0)
+            hashmap.reset(new Hashmap(keyRange));
+        else
+            hashmap->clear();
+        const double pause = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        if (!refill)
+            return pause * 1e3;
+
+        begin = std::chrono::steady_clock::now();
+        for (int i = 0; i < keyRange; ++i)
+            hashmap->insert(i, -i);
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        return keyRange / seconds / 1e6;
+    }
+
+    void benchmarkClear()
+    {
+        printHeader("Resetting a 1M-entry map", { 1 }, "pause in ms");
+        printRow("recreate", "destroy+create", [](int) { return measureClear(0, false); });
+        printRow("clear", "bumps gen.", [](int) { return measureClear(1, false); });
+
+        printHeader("Refilling the 1M keys after the reset", { 1 });
+        printRow("recreate", "", [](int) { return measureClear(0, true); });
+        printRow("clear", "purge on touch", [](int) { return measureClear(1, true); });
+    }
+
+    // insert and erase through flat combining, for measureStringWrites
+    template<class Map>
+    struct CombiningWrites
+    {
+        template<class Value>
+        void insert(int key, const Value& value)
+        {
+            map.combiningInsert(key, value);
+        }
+
+        void erase(int key)
+        {
+            map.combiningErase(key);
+        }
+
+        Map& map;
+    };
+
+    // Write-only mix of overwrites and erases of 256-char string values on few stripes, so that threads
+    // convoy on the locks and every byte freed under a lock counts.
+    template<class Map>
+    double measureStringWrites(Map& hashmap, int threadCount, int keyRange)
+    {
+        const int opsPerThread = 200000;
+        const std::string value(256, 'v');
+        const double seconds = runThreads(threadCount, [&hashmap, &value, keyRange](int threadIndex)
+        {
+            Random random(threadIndex);
+            for (int i = 0; i < opsPerThread; ++i)
+            {
+                const std::uint64_t r = random.next();
+                const int key = static_cast<int>(r % keyRange);
+                if ((r >> 32) % 4 == 0)
+                    hashmap.erase(key);
+                else
+                    hashmap.insert(key, value);
+            }
+        });
+        return threadCount * opsPerThread / seconds / 1e6;
+    }
+
+    void benchmarkStringWrites()
+    {
+        const int keyRange = 1 << 12;
+        printHeader("75% inserts / 25% erases of 256-char string values, 4k keys");
+        printRow("plain", "4 stripes", [keyRange](int threads)
+        {
+            ConcurrentHashmap<int, std::string> hashmap(keyRange, 4);
+            return measureStringWrites(hashmap, threads, keyRange);
+        });
+        printRow("combining", "4 stripes", [keyRange](int threads)
+        {
+            ConcurrentHashmap<int, std::string> hashmap(keyRange, 4);
+            CombiningWrites<ConcurrentHashmap<int, std::string>> writes{ hashmap };
+            return measureStringWrites(writes, threads, keyRange);
+        });
+    }
+
+    // splitmix64 finalizer, so that integer keys collide like random ones instead of filling buckets in order
+    struct MixedHash
+    {
+        std::size_t operator()(int key) const
+        {
+            return static_cast<std::size_t>(mixHash(static_cast<std::uint64_t>(key)));
+        }
+    };
+
+    template<class MapPolicy>
+    double measureInlineLookups(int threads, double loadFactor)
+    {
+        const int keyRange = 1 << 21;
+        ConcurrentHashmap<int, int, MixedHash, std::mutex, MapPolicy> hashmap(static_cast<std::size_t>(keyRange / loadFactor));
+        for (int i = 0; i < keyRange; ++i)
+            hashmap.insert(i, i);
+        return measureLookups(hashmap, threads, keyRange);
+    }
+
+    void benchmarkInline()
+    {
+        printHeader("Lookups of 2M keys, heap nodes vs first node inline in the bucket");
+        const double loadFactors[] = { 0.5, 1, 2 };
+        const char* parameters[] = { "load 0.5", "load 1", "load 2" };
+        for (int i = 0; i < 3; ++i)
+        {
+            const double loadFactor = loadFactors[i];
+            printRow("heap nodes", parameters[i], [loadFactor](int threads) { return measureInlineLookups<DefaultMapPolicy>(threads, loadFactor); });
+            printRow("inline first", parameters[i], [loadFactor](int threads) { return measureInlineLookups<InlineFirstNodePolicy>(threads, loadFactor); });
+        }
+    }
+
+    // 1M entries, even keys of the looked up range, so half of the lookups miss
+    template<class Map>
+    double measureLoadFactorLookups(Map& hashmap, int threads)
+    {
+        const int keyRange = 1 << 21;
+        if (hashmap.size() == 0)
+        {
+            for (int i = 0; i < keyRange; i += 2)
+                hashmap.insert(i, i);
+        }
+        return measureLookups(hashmap, threads, keyRange);
+    }
+
+    void benchmarkUnrolled()
+    {
+        const std::size_t entries = 1 << 20;
+        printHeader("Lookups in 1M int entries, 50% misses, one-entry nodes vs unrolled chunks");
+        const std::size_t loadFactors[] = { 1, 2, 4, 8 };
+        const char* parameters[] = { "load 1", "load 2", "load 4", "load 8" };
+        for (int i = 0; i < 4; ++i)
+        {
+            const std::size_t buckets = entries / loadFactors[i];
+            {
+                ConcurrentHashmap<int, int, MixedHash> hashmap(buckets);
+                printRow("nodes", parameters[i], [&hashmap](int threads) { return measureLoadFactorLookups(hashmap, threads); });
+            }
+            {
+                ConcurrentUnrolledHashmap<int, int> hashmap(buckets);
+                printRow("unrolled 64B", parameters[i], [&hashmap](int threads) { return measureLoadFactorLookups(hashmap, threads); });
+            }
+            {
+                ConcurrentUnrolledHashmap<int, int, std::hash<int>, std::mutex, 128> hashmap(buckets);
+                printRow("unrolled 128B", parameters[i], [&hashmap](int threads) { return measureLoadFactorLookups(hashmap, threads); });
+            }
+        }
+    }
+
+    void benchmarkSortedChains()
+    {
+        const std::size_t entries = 1 << 20;
+        printHeader("Lookups in 1M int entries, 50% misses, unordered vs hash-sorted chains");
+        const std::size_t loadFactors[] = { 1, 8, 32 };
+        const char* parameters[] = { "load 1", "load 8", "load 32" };
+        for (int i = 0; i < 3; ++i)
+        {
+            const std::size_t buckets = entries / loadFactors[i];
+            {
+                ConcurrentHashmap<int, int, MixedHash> hashmap(buckets);
+                printRow("unordered", parameters[i], [&hashmap](int threads) { return measureLoadFactorLookups(hashmap, threads); });
+            }
+            {
+                ConcurrentHashmap<int, int, MixedHash, std::mutex, SortedChainsPolicy> hashmap(buckets);
+                printRow("sorted", parameters[i], [&hashmap](int threads) { return measureLoadFactorLookups(hashmap, threads); });
+            }
+        }
+    }
+
+    // string-keyed counter increments with Zipf(0.99) key popularity over 10k keys
+    template<class Increment>
+    double measureCounters(int threadCount, const std::vector<std::string>& keys, Increment increment)
+    {
+        const int opsPerThread = 200000;
+        const Zipf zipf(keys.size(), 0.99);
+        const double seconds = runThreads(threadCount, [&keys, &zipf, &increment](int threadIndex)
+        {
+            Random random(threadIndex);
+            for (int i = 0; i < opsPerThread; ++i)
+                increment(keys[zipf.next(random)]);
+        });
+        return threadCount * opsPerThread / seconds / 1e6;
+    }
+
+    void benchmarkCounters()
+    {
+        const std::size_t keyCount = 10000;
+        std::vector<std::string> keys;
+        for (std::size_t i = 0; i < keyCount; ++i)
+            keys.push_back("metric." + std::to_string(i));
+
+        printHeader("Counter increments, Zipf(0.99) over 10k string keys");
+        printRow("locked get", "", [&keys](int threads)
+        {
+            ConcurrentHashmap<std::string, long> counters(keys.size());
+            for (const std::string& key : keys)
+                counters.insert(key, 0);
+            return measureCounters(threads, keys, [&counters](const std::string& key) { ++counters.get(key).first; });
+        });
+        printRow("counter map", "", [&keys](int threads)
+        {
+            ConcurrentCounterMap<std::string> counters(keys.size());
+            return measureCounters(threads, keys, [&counters](const std::string& key) { counters.increment(key); });
+        });
+        printRow("counter map", "top 8 spread", [&keys](int threads)
+        {
+            ConcurrentCounterMap<std::string> counters(keys.size());
+            for (std::size_t i = 0; i < 8; ++i)
+                counters.spreadCounter(keys[i]);
+            return measureCounters(threads, keys, [&counters](const std::string& key) { counters.increment(key); });
+        });
+    }
+
+    // 50% contains / 25% insert / 25% erase on 1M uint64 keys
+    template<class Hashset>
+    double measureHashset(Hashset& hashset, int threadCount)
+    {
+        const int opsPerThread = 1000000 / threadCount;
+        const std::uint64_t keyRange = 1 << 20;
+        const double seconds = runThreads(threadCount, [&hashset, opsPerThread, keyRange](int threadIndex)
+        {
+            Random random(threadIndex);
+            for (int i = 0; i < opsPerThread; ++i)
+            {
+                const std::uint64_t r = random.next();
+                const std::uint64_t key = (r >> 8) % keyRange;
+                if (r & 1)
+                    hashset.contains(key);
+                else if (r & 2)
+                    hashset.insert(key);
+                else
+                    hashset.erase(key);
+            }
+        });
+        return threadCount * opsPerThread / seconds / 1e6;
+    }
+
+    // ConcurrentHashmap<uint64_t, bool> used as a set
+    class BoolMapSet
+    {
+    public:
+        explicit BoolMapSet(std::size_t capacity) : mMap(capacity) {}
+
+        std::size_t size() const { return mMap.size(); }
+        bool insert(std::uint64_t key) { return mMap.insert(key, true); }
+        bool contains(std::uint64_t key) const { return mMap.find(key); }
+        bool erase(std::uint64_t key) { return mMap.erase(key); }
+
+    private:
+        ConcurrentHashmap<std::uint64_t, bool> mMap;
+    };
+
+    template<class Hashset>
+    void benchmarkHashsetVariant(const char* name)
+    {
+        const std::size_t keyRange = 1 << 20;
+        const std::size_t heapBefore = heapInUse();
+        {
+            Hashset hashset(keyRange);
+            for (std::uint64_t key = 0; key < keyRange; ++key)
+                hashset.insert(key);
+            std::printf("%-14s %zu bytes per entry\n", name, (heapInUse() - heapBefore) / hashset.size());
+        }
+        printRow(name, "", [](int threads)
+        {
+            Hashset hashset(keyRange);
+            for (std::uint64_t key = 0; key < keyRange; key += 2)
+                hashset.insert(key);
+            return measureHashset(hashset, threads);
+        });
+    }
+
+    void benchmarkHashset()
+    {
+        printHeader("uint64 sets with capacity 1M, 50% contains / 25% insert / 25% erase");
+        benchmarkHashsetVariant<BoolMapSet>("map<K, bool>");
+        benchmarkHashsetVariant<ChainedConcurrentHashset<std::uint64_t>>("chained set");
+        benchmarkHashsetVariant<DenseConcurrentHashset<std::uint64_t>>("dense set");
+    }
+
+    // 90% read all values of a key / 10% append, 1000 keys with 32 values each
+    template<class Read, class Append>
+    double measureMultimap(int threadCount, Read read, Append append)
+    {
+        const int opsPerThread = 100000;
+        const double seconds = runThreads(threadCount, [&read, &append](int threadIndex)
+        {
+            Random random(threadIndex);
+            for (int i = 0; i < opsPerThread; ++i)
+            {
+                const std::uint64_t r = random.next();
+                const int key = static_cast<int>((r >> 8) % 1000);
+                if (r % 10)
+                    read(key);
+                else
+                    append(key, i);
+            }
+        });
+        return threadCount * opsPerThread / seconds / 1e6;
+    }
+
+    void benchmarkMultimap()
+    {
+        printHeader("One key to many values, 90% read all values / 10% append");
+        printRow("map of vectors", "getCopy", [](int threads)
+        {
+            ConcurrentHashmap<int, std::vector<int>> hashmap(1000);
+            for (int key = 0; key < 1000; ++key)
+                hashmap.insert(key, std::vector<int>(32, key));
+            std::atomic<long> sum(0);
+            return measureMultimap(threads,
+                [&hashmap, &sum](int key)
+                {
+                    long localSum = 0;
+                    for (int value : hashmap.getCopy(key))
+                        localSum += value;
+                    sum += localSum;
+                },
+                [&hashmap](int key, int value)
+                {
+                    std::vector<int> values = hashmap.getCopy(key);
+                    values.push_back(value);
+                    hashmap.insert(key, values);
+                });
+        });
+        printRow("multimap", "forEachValue", [](int threads)
+        {
+            ConcurrentMultimap<int, int> multimap(1000);
+            for (int key = 0; key < 1000; ++key)
+                for (int i = 0; i < 32; ++i)
+                    multimap.append(key, key);
+            std::atomic<long> sum(0);
+            return measureMultimap(threads,
+                [&multimap, &sum](int key)
+                {
+                    long localSum = 0;
+                    multimap.forEachValue(key, [&localSum](int value) { localSum += value; });
+                    sum += localSum;
+                },
+                [&multimap](int key, int value) { multimap.append(key, value); });
+        });
+    }
+
+    // the sorted companion structure the ordered map replaces
+    struct LockedOrderedMap
+    {
+        bool find(int key) const
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return map.count(key) != 0;
+        }
+
+        void insert(int key, int value)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            map[key] = value;
+        }
+
+        template<class Function>
+        void rangeScan(int from, int to, Function fn) const
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (std::map<int, int>::const_iterator it = map.lower_bound(from); it != map.end() && it->first < to; ++it)
+                fn(it->first, it->second);
+        }
+
+        mutable std::mutex mutex;
+        std::map<int, int> map;
+    };
+
+    // 90% scans of 100 consecutive keys / 10% overwrites, in Mscans+writes/s
+    template<class OrderedMap>
+    double measureRangeScans(OrderedMap& map, int threadCount, int keyRange)
+    {
+        const int opsPerThread = 100000;
+        std::atomic<long> sum(0);
+        const double seconds = runThreads(threadCount, [&map, &sum, keyRange](int threadIndex)
+        {
+            Random random(threadIndex);
+            long localSum = 0;
+            for (int i = 0; i < opsPerThread; ++i)
+            {
+                const std::uint64_t r = random.next();
+                const int key = static_cast<int>((r >> 8) % keyRange);
+                if (r % 10)
+                    map.rangeScan(key, key + 100, [&localSum](int, int value) { localSum += value; });
+                else
+                    map.insert(key, i);
+            }
+            sum += localSum;
+        });
+        return threadCount * opsPerThread / seconds / 1e6;
+    }
+
+    void benchmarkOrdered()
+    {
+        const int keyRange = 1 << 20;
+        ConcurrentHashmap<int, int> hashmap(keyRange);
+        ConcurrentOrderedMap<int, int> ordered;
+        LockedOrderedMap locked;
+        for (int i = 0; i < keyRange; ++i)
+        {
+            hashmap.insert(i, i);
+            ordered.insert(i, i);
+            locked.insert(i, i);
+        }
+
+        printHeader("Point lookups in 1M keys, hash map vs ordered maps");
+        printRow("striped hash", "", [&hashmap, keyRange](int threads) { return measureLookups(hashmap, threads, keyRange); });
+        printRow("skip list", "", [&ordered, keyRange](int threads) { return measureLookups(ordered, threads, keyRange); });
+        printRow("std::map", "global lock", [&locked, keyRange](int threads) { return measureLookups(locked, threads, keyRange); });
+
+        printHeader("Ordered maps of 1M keys, 90% scans of 100 keys / 10% overwrites");
+        printRow("skip list", "", [&ordered, keyRange](int threads) { return measureRangeScans(ordered, threads, keyRange); });
+        printRow("std::map", "global lock", [&locked, keyRange](int threads) { return measureRangeScans(locked, threads, keyRange); });
+    }
+
+    struct Benchmark
+    {
+        const char* name;
+        void (*run)();
+    };
+
+    const Benchmark Benchmarks[] =
+    {
+        { "locks", benchmarkLockPolicies },
+        { "bucketlock", benchmarkBucketBitLock },
+        { "stripemapping", benchmarkStripeMapping },
+        { "splitting", benchmarkStripeSplitting },
+        { "numa", benchmarkNuma },
+        { "combining", benchmarkFlatCombining },
+        { "delegation", benchmarkDelegation },
+        { "bulkwriter", benchmarkBulkWriter },
+        { "bulkload", benchmarkBulkLoad },
+        { "frozen", benchmarkFrozen },
+        { "flat", benchmarkFlat },
+        { "insertonly", benchmarkInsertOnly },
+        { "counters", benchmarkCounters },
+        { "hashset", benchmarkHashset },
+        { "multimap", benchmarkMultimap },
+        { "ordered", benchmarkOrdered },
+        { "versioned", benchmarkVersioned },
+        { "splice", benchmarkSplice },
+        { "publish", benchmarkPublish },
+        { "clear", benchmarkClear },
+        { "stringwrites", benchmarkStringWrites },
+        { "inline", benchmarkInline },
+        { "unrolled", benchmarkUnrolled },
+        { "sorted", benchmarkSortedChains },
+    };
+}
+
+// Usage: hashmap_benchmark [name...]; runs all benchmarks when no names are given.
+int main(int argc, char* argv[])
+{
+    for (const Benchmark& benchmark : Benchmarks)
+    {
+        bool selected = argc < 2;
+        for (int i = 1; i < argc; ++i)
+            selected = selected || std::strcmp(argv[i], benchmark.name) == 0;
+
+        if (selected)
+            benchmark.run();
+    }
+    return 0;
+}
@@ -2,7 +2,12 @@
 #include "testHelpers.h"
 
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <iterator>
 #include <memory>
+#include <set>
+#include <string>
+#include <vector>
 
 using namespace testing;
 
@@ -239,3 +244,586 @@ TEST(HashmapGetTest, GetDoesntMakeValueCopies)
 
     ASSERT_EQ(1, Value::copied);
 }
+
+TEST(HashmapBucketBitLockTest, LockedValueHoldsBucketLock)
+{
+    ConcurrentHashmap<int, int, IntHashFunction, BucketBitLock> hashmap(10, 16, dummyIntHash);
+    hashmap.insert(1, 2);
+    hashmap.insert(3, 4);
+
+    ConcurrentHashmap<int, int, IntHashFunction, BucketBitLock>::LockedValue lockedValue = hashmap.get(3);
+    ASSERT_EQ(4, lockedValue.first);
+    ASSERT_FALSE(lockedValue.second.mutex()->try_lock());
+    lockedValue.second.unlock();
+
+    hashmap.erase(1);
+    ASSERT_EQ(1, hashmap.size());
+    ASSERT_EQ(4, hashmap.getCopy(3));
+}
+
+TEST_F(HashmapTest, CombiningInsertAndEraseBehaveLikePlainOnes)
+{
+    hashmap.combiningInsert(1, 1);
+    hashmap.combiningInsert(2, 2);
+    hashmap.combiningInsert(1, 10);
+
+    ASSERT_EQ(2, hashmap.size());
+    ASSERT_EQ(10, hashmap.getCopy(1));
+
+    hashmap.combiningErase(1);
+    hashmap.combiningErase(3);
+
+    ASSERT_EQ(1, hashmap.size());
+    ASSERT_FALSE(hashmap.find(1));
+}
+
+TEST_F(HashmapTest, BulkWriterWritesOnFlush)
+{
+    ConcurrentHashmap<int, int>::BulkWriter writer(hashmap, 100);
+    writer.insert(1, 1);
+    writer.insert(2, 2);
+    writer.insert(1, 10);
+
+    ASSERT_FALSE(hashmap.find(1));
+
+    writer.flush();
+
+    ASSERT_EQ(2, hashmap.size());
+    ASSERT_EQ(10, hashmap.getCopy(1));
+}
+
+TEST_F(HashmapTest, BulkWriterFlushesFullBatches)
+{
+    {
+        ConcurrentHashmap<int, int>::BulkWriter writer(hashmap, 1);
+        writer.insert(1, 1);
+
+        ASSERT_TRUE(hashmap.find(1));
+        writer.insert(2, 2);
+    }
+
+    ASSERT_EQ(2, hashmap.size());
+}
+
+namespace
+{
+    // Erases the two following keys when destroyed and records the size seen right after.
+    struct ErasingValue
+    {
+        typedef ConcurrentHashmap<int, ErasingValue> Map;
+
+        ErasingValue() : map(nullptr), key(0), sizeSeen(nullptr) {}
+
+        ~ErasingValue()
+        {
+            if (map)
+            {
+                map->erase(key + 1);
+                map->erase(key + 2);
+                *sizeSeen = map->size();
+            }
+        }
+
+        Map* map;
+        int key;
+        std::size_t* sizeSeen;
+    };
+}
+
+TEST(HashmapBulkWriterSizeTest, SizeDoesntWrapWhileBatchIsUncounted)
+{
+    ErasingValue::Map hashmap(1, 1);
+    std::size_t sizeSeen = 1234;
+    hashmap.insert(1, ErasingValue());
+    {
+        ErasingValue::Map::LockedValue value = hashmap.get(1);
+        value.first.map = &hashmap;
+        value.first.key = 1;
+        value.first.sizeSeen = &sizeSeen;
+    }
+
+    // the overwritten value erases the batch's new keys before the batch counts them
+    {
+        ErasingValue::Map::BulkWriter writer(hashmap, 3);
+        writer.insert(2, ErasingValue());
+        writer.insert(3, ErasingValue());
+        writer.insert(1, ErasingValue());
+    }
+
+    ASSERT_EQ(0, sizeSeen);
+    ASSERT_EQ(1, hashmap.size());
+}
+
+TEST_F(HashmapTest, BulkLoadInsertsAndOverwrites)
+{
+    hashmap.insert(1, 0);
+    std::vector<std::pair<int, int>> values = { { 1, 1 }, { 2, 2 }, { 3, 3 }, { 2, 20 } };
+    hashmap.bulkLoad(values.begin(), values.end(), 2);
+
+    ASSERT_EQ(3, hashmap.size());
+    ASSERT_EQ(1, hashmap.getCopy(1));
+    ASSERT_EQ(20, hashmap.getCopy(2));
+
+    hashmap.erase(3);
+    hashmap.insert(3, 30);
+
+    ASSERT_EQ(30, hashmap.getCopy(3));
+}
+
+TEST_F(HashmapTest, BulkLoadFreesArenasWithTheirLastNodes)
+{
+    // erases and overwrites free every round's arena, so the rounds never run out of arenas
+    for (int round = 0; round < 200; ++round)
+    {
+        std::vector<std::pair<int, int>> values = { { 1, round }, { 2, round }, { 3, round } };
+        hashmap.bulkLoad(values.begin(), values.end(), 2);
+        ASSERT_EQ(round, hashmap.getCopy(1));
+        ASSERT_TRUE(hashmap.erase(1));
+        ASSERT_FALSE(hashmap.extract(2).empty());
+    }
+    ASSERT_EQ(1, hashmap.size());
+
+    // beyond the live arenas' limit nodes are allocated one by one
+    for (int key = 10; key < 210; ++key)
+    {
+        std::vector<std::pair<int, int>> values = { { key, key } };
+        hashmap.bulkLoad(values.begin(), values.end(), 1);
+    }
+    ASSERT_EQ(201, hashmap.size());
+    for (int key = 10; key < 210; ++key)
+        ASSERT_EQ(key, hashmap.getCopy(key));
+}
+
+TEST(InsertOnlyHashmapTest, OverwritesByReplacingNodes)
+{
+    ConcurrentHashmap<int, int, std::hash<int>, std::mutex, InsertOnlyPolicy> hashmap(1);
+    hashmap.insert(1, 1);
+    hashmap.insert(2, 2);
+    hashmap.insert(1, 10);
+    hashmap.insert(2, 20);
+
+    ASSERT_EQ(2, hashmap.size());
+    ASSERT_EQ(10, hashmap.getCopy(1));
+    ASSERT_EQ(20, hashmap.getCopy(2));
+    ASSERT_FALSE(hashmap.find(3));
+    ASSERT_THROW(hashmap.getCopy(3), ConcurrentHashmapException);
+}
+
+TEST(InsertOnlyHashmapTest, RetiresNodesReplacedByBatchedInserts)
+{
+    typedef ConcurrentHashmap<int, int, std::hash<int>, std::mutex, InsertOnlyPolicy> Hashmap;
+    Hashmap hashmap(4, 2);
+    std::vector<std::pair<int, int>> values;
+    for (int i = 0; i < 20; ++i)
+        values.push_back(std::make_pair(i, i));
+    hashmap.bulkLoad(values.begin(), values.end(), 2);
+
+    for (int i = 0; i < 20; i += 2)
+        hashmap.combiningInsert(i, i * 10);
+    {
+        Hashmap::BulkWriter writer(hashmap, 4);
+        for (int i = 1; i < 20; i += 2)
+            writer.insert(i, i * 10);
+    }
+    hashmap.bulkLoad(values.begin(), values.begin() + 5, 1);
+
+    ASSERT_EQ(20, hashmap.size());
+    for (int i = 0; i < 20; ++i)
+        ASSERT_EQ(i < 5 ? i : i * 10, hashmap.getCopy(i));
+}
+
+TEST_F(HashmapTest, InsertAndEraseReportWhetherKeyWasPresent)
+{
+    ASSERT_TRUE(hashmap.insert(1, 1));
+    ASSERT_FALSE(hashmap.insert(1, 2));
+    ASSERT_TRUE(hashmap.erase(1));
+    ASSERT_FALSE(hashmap.erase(1));
+}
+
+TEST_F(HashmapTest, FindsBatchesInInputOrder)
+{
+    hashmap.insert(1, 1);
+    hashmap.insert(12, 12);
+    std::vector<int> keys = { 12, 2, 1, 11 };
+    std::vector<bool> results;
+
+    hashmap.findAll(keys.begin(), keys.end(), std::back_inserter(results));
+
+    ASSERT_EQ(std::vector<bool>({ true, false, true, false }), results);
+}
+
+TEST_F(HashmapTest, VisitsUpsertsAndErasesInPlace)
+{
+    ASSERT_TRUE(hashmap.upsert(1, [](int& value) { value += 5; }));
+    ASSERT_FALSE(hashmap.upsert(1, [](int& value) { value *= 2; }));
+
+    int visited = 0;
+    ASSERT_TRUE(hashmap.visit(1, [&visited](const int& value) { visited = value; }));
+    ASSERT_FALSE(hashmap.visit(2, [&visited](const int&) { visited = -1; }));
+    ASSERT_EQ(10, visited);
+
+    ASSERT_FALSE(hashmap.eraseIf(1, [](int& value) { return --value == 0; }));
+    ASSERT_EQ(9, hashmap.getCopy(1));
+    ASSERT_TRUE(hashmap.eraseIf(1, [](int& value) { return value == 9; }));
+    ASSERT_EQ(0, hashmap.size());
+}
+
+TEST_F(HashmapTest, TransactsOverSeveralKeys)
+{
+    typedef ConcurrentHashmap<int, int>::Transaction Transaction;
+    hashmap.insert(1, 100);
+
+    const bool moved = hashmap.transact({ 1, 2, 1 }, [](Transaction& transaction)
+    {
+        if (transaction.get(0) < 30)
+            return false;
+        transaction.get(0) -= 30;
+        if (!transaction.find(1))
+            transaction.insert(1, 0);
+        transaction.get(1) += 30;
+        return true;
+    });
+
+    ASSERT_TRUE(moved);
+    ASSERT_EQ(70, hashmap.getCopy(1));
+    ASSERT_EQ(30, hashmap.getCopy(2));
+    ASSERT_EQ(2, hashmap.size());
+
+    hashmap.transact({ 1, 3 }, [](Transaction& transaction)
+    {
+        ASSERT_THROW(transaction.get(1), ConcurrentHashmapException);
+        ASSERT_TRUE(transaction.erase(0));
+        ASSERT_FALSE(transaction.erase(1));
+    });
+    ASSERT_FALSE(hashmap.find(1));
+    ASSERT_EQ(1, hashmap.size());
+}
+
+TEST(VersionedHashmapTest, ComparesAndSetsOnVersion)
+{
+    ConcurrentHashmap<int, int, std::hash<int>, std::mutex, VersionedPolicy> hashmap(10);
+    hashmap.insert(1, 10);
+
+    const std::pair<int, std::uint64_t> read = hashmap.getVersioned(1);
+    ASSERT_EQ(10, read.first);
+    ASSERT_TRUE(hashmap.compareAndSet(1, read.second, read.first + 1));
+    ASSERT_FALSE(hashmap.compareAndSet(1, read.second, 0));
+    ASSERT_EQ(11, hashmap.getCopy(1));
+
+    ASSERT_FALSE(hashmap.compareAndSet(2, read.second, 0));
+    ASSERT_THROW(hashmap.getVersioned(2), ConcurrentHashmapException);
+}
+
+namespace
+{
+    struct VersionedSortedChainsPolicy : VersionedPolicy
+    {
+        static const bool SortedChains = true;
+    };
+}
+
+TEST(VersionedHashmapTest, CombinesWithSortedChains)
+{
+    ConcurrentHashmap<int, int, std::hash<int>, std::mutex, VersionedSortedChainsPolicy> hashmap(2);
+    for (int i = 0; i < 10; ++i)
+        hashmap.insert(i, i);
+
+    const std::pair<int, std::uint64_t> read = hashmap.getVersioned(5);
+    ASSERT_TRUE(hashmap.compareAndSet(5, read.second, 50));
+    ASSERT_FALSE(hashmap.compareAndSet(5, read.second, 0));
+    ASSERT_EQ(50, hashmap.getCopy(5));
+    ASSERT_EQ(10, hashmap.size());
+}
+
+TEST(VersionedHashmapTest, EveryWriteChangesVersion)
+{
+    ConcurrentHashmap<int, int, std::hash<int>, std::mutex, VersionedPolicy> hashmap(10);
+    hashmap.insert(1, 10);
+    std::uint64_t version = hashmap.getVersioned(1).second;
+
+    hashmap.insert(1, 10);
+    ASSERT_NE(version, hashmap.getVersioned(1).second);
+    version = hashmap.getVersioned(1).second;
+
+    hashmap.get(1).first = 12;
+    ASSERT_NE(version, hashmap.getVersioned(1).second);
+    version = hashmap.getVersioned(1).second;
+
+    hashmap.upsert(1, [](int& value) { ++value; });
+    ASSERT_NE(version, hashmap.getVersioned(1).second);
+    version = hashmap.getVersioned(1).second;
+
+    // erased and inserted again with the same value
+    hashmap.erase(1);
+    hashmap.insert(1, 13);
+    ASSERT_FALSE(hashmap.compareAndSet(1, version, 0));
+    ASSERT_EQ(13, hashmap.getCopy(1));
+}
+
+TEST_F(HashmapTest, ExtractsNodesIntoAnotherMap)
+{
+    ConcurrentHashmap<int, int> target(Capacity);
+    hashmap.insert(1, 10);
+
+    ConcurrentHashmap<int, int>::NodeHandle handle = hashmap.extract(1);
+    ASSERT_FALSE(handle.empty());
+    ASSERT_EQ(1, handle.key());
+    ASSERT_EQ(10, handle.value());
+    ASSERT_FALSE(hashmap.find(1));
+    ASSERT_EQ(0, hashmap.size());
+    ASSERT_TRUE(hashmap.extract(1).empty());
+
+    ASSERT_TRUE(target.insert(std::move(handle)));
+    ASSERT_TRUE(handle.empty());
+    ASSERT_EQ(10, target.getCopy(1));
+    ASSERT_EQ(1, target.size());
+
+    hashmap.insert(1, 20);
+    ASSERT_FALSE(target.insert(hashmap.extract(1)));
+    ASSERT_EQ(20, target.getCopy(1));
+    ASSERT_EQ(1, target.size());
+}
+
+TEST_F(HashmapTest, MovesMatchingEntriesToAnotherMap)
+{
+    std::unique_ptr<ConcurrentHashmap<int, int>> source(new ConcurrentHashmap<int, int>(64, 4));
+    ConcurrentHashmap<int, int> target(Capacity);
+    std::vector<std::pair<int, int>> pairs;
+    for (int i = 0; i < 100; ++i)
+        pairs.push_back(std::make_pair(i, i * 10));
+    // arena nodes have to be copied, since the target outlives the source
+    source->bulkLoad(pairs.begin(), pairs.begin() + 50, 1);
+    for (int i = 50; i < 100; ++i)
+        source->insert(i, i * 10);
+    target.insert(0, -1);
+
+    const std::size_t moved = source->moveAll([](int key, int) { return key % 2 == 0; }, target);
+    source.reset();
+
+    ASSERT_EQ(50, moved);
+    ASSERT_EQ(50, target.size());
+    for (int i = 0; i < 100; i += 2)
+        ASSERT_EQ(i * 10, target.getCopy(i));
+}
+
+TEST(ClearableHashmapTest, ClearHidesAllEntriesAtOnce)
+{
+    ConcurrentHashmap<int, int, std::hash<int>, std::mutex, ClearablePolicy> hashmap(10);
+    std::vector<std::pair<int, int>> pairs;
+    for (int i = 0; i < 20; ++i)
+        pairs.push_back(std::make_pair(i, i));
+    hashmap.bulkLoad(pairs.begin(), pairs.end(), 1);
+    hashmap.insert(100, 100);
+
+    hashmap.clear();
+
+    ASSERT_EQ(0, hashmap.size());
+    ASSERT_FALSE(hashmap.find(100));
+    ASSERT_THROW(hashmap.getCopy(5), ConcurrentHashmapException);
+    std::size_t visited = 0;
+    hashmap.forEach([&visited](int, int) { ++visited; });
+    ASSERT_EQ(0, visited);
+
+    ASSERT_TRUE(hashmap.insert(5, 50));
+    ASSERT_EQ(1, hashmap.size());
+    ASSERT_EQ(50, hashmap.getCopy(5));
+
+    hashmap.clear();
+    hashmap.reclaim();
+    ASSERT_EQ(0, hashmap.size());
+    ASSERT_TRUE(hashmap.insert(5, 60));
+    ASSERT_EQ(60, hashmap.getCopy(5));
+}
+
+// Looks its key up when destroyed, which deadlocks if the map destroys it under the bucket lock.
+template<class MapPolicy>
+struct LookingUpValue
+{
+    typedef ConcurrentHashmap<int, LookingUpValue, std::hash<int>, std::mutex, MapPolicy> Map;
+
+    LookingUpValue() : map(nullptr), key(0) {}
+    LookingUpValue(const Map* map, int key) : map(map), key(key) {}
+
+    ~LookingUpValue()
+    {
+        if (map)
+            map->find(key);
+    }
+
+    const Map* map;
+    int key;
+};
+
+TEST(HashmapDeferredFreeingTest, DestroysNodesOutsideBucketLocks)
+{
+    typedef LookingUpValue<DefaultMapPolicy> Value;
+    typedef Value::Map Hashmap;
+    Hashmap hashmap(1, 1);
+    const Value first(&hashmap, 1);
+    const Value second(&hashmap, 2);
+
+    hashmap.insert(1, first);
+    ASSERT_FALSE(hashmap.insert(1, second));
+    ASSERT_TRUE(hashmap.erase(1));
+
+    hashmap.combiningInsert(1, first);
+    hashmap.combiningInsert(1, second);
+    hashmap.combiningErase(1);
+    {
+        Hashmap::BulkWriter writer(hashmap, 2);
+        writer.insert(1, first);
+        writer.insert(1, second);
+    }
+    hashmap.transact({ 1 }, [](Hashmap::Transaction& transaction) { ASSERT_TRUE(transaction.erase(0)); });
+    ASSERT_EQ(0, hashmap.size());
+}
+
+TEST(HashmapDeferredFreeingTest, DestroysClearedNodesOutsideBucketLocks)
+{
+    typedef LookingUpValue<ClearablePolicy> Value;
+    typedef Value::Map Hashmap;
+    Hashmap hashmap(1, 1);
+
+    // every operation below first finds the bucket stale and destroys the previous key's node
+    hashmap.insert(1, Value(&hashmap, 1));
+    hashmap.clear();
+    ASSERT_TRUE(hashmap.upsert(2, [&hashmap](Value& value)
+    {
+        value.map = &hashmap;
+        value.key = 2;
+    }));
+    hashmap.clear();
+    hashmap.transact({ 3 }, [&hashmap](Hashmap::Transaction& transaction)
+    {
+        ASSERT_TRUE(transaction.insert(0, Value()));
+        transaction.get(0).map = &hashmap;
+        transaction.get(0).key = 3;
+    });
+    hashmap.clear();
+    ASSERT_TRUE(hashmap.insert(4, Value(&hashmap, 4)));
+    ASSERT_EQ(1, hashmap.size());
+
+    hashmap.clear();
+    hashmap.reclaim();
+    ASSERT_EQ(0, hashmap.size());
+}
+
+TEST(HashmapDeferredFreeingTest, DestroysMovedInlineNodesOutsideBucketLocks)
+{
+    typedef LookingUpValue<InlineFirstNodePolicy> Value;
+    typedef Value::Map Hashmap;
+    Hashmap hashmap(1, 1);
+    Hashmap other(1, 1);
+
+    // the bucket's first key sits in its inline slot, so it is copied when it leaves the map
+    ASSERT_TRUE(hashmap.insert(1, Value(&hashmap, 1)));
+    ASSERT_TRUE(hashmap.insert(2, Value(&hashmap, 2)));
+    Hashmap::NodeHandle handle = hashmap.extract(1);
+    ASSERT_EQ(1, handle.value().key);
+
+    ASSERT_TRUE(hashmap.insert(3, Value(&hashmap, 3)));
+    ASSERT_EQ(2, hashmap.moveAll([](int, const Value&) { return true; }, other));
+    ASSERT_EQ(0, hashmap.size());
+    ASSERT_EQ(2, other.size());
+}
+
+namespace
+{
+    // pairs of keys share a hash, so that sorted chains hold runs of equal hashes
+    struct HalvingHash
+    {
+        std::size_t operator()(int key) const
+        {
+            return static_cast<std::size_t>(key / 2);
+        }
+    };
+}
+
+TEST(SortedChainsHashmapTest, FindsKeysInChainsOrderedByHash)
+{
+    typedef ConcurrentHashmap<int, std::string, HalvingHash, std::mutex, SortedChainsPolicy> Hashmap;
+    Hashmap hashmap(1);
+    Hashmap other(3);
+
+    // a single bucket: every key goes into one chain, inserted out of hash order
+    const int keys[] = { 9, 2, 14, 3, 0, 8, 15, 1, 5 };
+    for (int key : keys)
+        ASSERT_TRUE(hashmap.insert(key, std::to_string(key)));
+    ASSERT_FALSE(hashmap.insert(3, "overwritten"));
+    const std::set<int> present(std::begin(keys), std::end(keys));
+    for (int key = 0; key < 20; ++key)
+        ASSERT_EQ(present.count(key) == 1, hashmap.find(key));
+    ASSERT_EQ("overwritten", hashmap.getCopy(3));
+
+    ASSERT_TRUE(hashmap.erase(2));
+    ASSERT_FALSE(hashmap.erase(2));
+    ASSERT_FALSE(hashmap.erase(4));
+    Hashmap::NodeHandle handle = hashmap.extract(15);
+    ASSERT_EQ("15", handle.value());
+    ASSERT_TRUE(other.insert(std::move(handle)));
+    hashmap.combiningInsert(4, "combined");
+    hashmap.combiningErase(14);
+    hashmap.transact({ 7, 0 }, [](Hashmap::Transaction& transaction)
+    {
+        transaction.insert(0, "transacted");
+        transaction.erase(1);
+    });
+    hashmap.moveAll([](int key, const std::string&) { return key >= 8; }, other);
+
+    ASSERT_EQ(5, hashmap.size());
+    ASSERT_EQ("transacted", hashmap.getCopy(7));
+    ASSERT_EQ("combined", hashmap.getCopy(4));
+    ASSERT_FALSE(hashmap.find(0));
+    ASSERT_FALSE(hashmap.find(14));
+    ASSERT_EQ(3, other.size());
+    ASSERT_EQ("15", other.getCopy(15));
+    ASSERT_EQ("9", other.getCopy(9));
+
+    std::vector<int> keysInOrder;
+    hashmap.forEach([&keysInOrder](int key, const std::string&) { keysInOrder.push_back(key / 2); });
+    ASSERT_TRUE(std::is_sorted(keysInOrder.begin(), keysInOrder.end()));
+}
+
+namespace
+{
+    struct ClearableInlineFirstNodePolicy : InlineFirstNodePolicy
+    {
+        static const bool Clearable = true;
+    };
+}
+
+TEST(InlineFirstNodeHashmapTest, StoresFirstNodesInBucketsAndOverflowsOnCollisions)
+{
+    typedef ConcurrentHashmap<int, std::string, std::hash<int>, std::mutex, ClearableInlineFirstNodePolicy> Hashmap;
+    Hashmap hashmap(4, 2);
+    Hashmap other(4);
+
+    // 4 buckets: keys 0, 4 and 8 share one, the first of them takes its slot
+    for (int i = 0; i < 12; ++i)
+        ASSERT_TRUE(hashmap.insert(i, std::string(40, static_cast<char>('a' + i))));
+    ASSERT_FALSE(hashmap.insert(0, "overwritten"));
+    ASSERT_EQ("overwritten", hashmap.getCopy(0));
+    ASSERT_TRUE(hashmap.erase(4));
+    ASSERT_TRUE(hashmap.insert(4, "again"));
+
+    Hashmap::NodeHandle handle = hashmap.extract(1);
+    ASSERT_EQ(std::string(40, 'b'), handle.value());
+    hashmap.moveAll([](int key, const std::string&) { return key % 4 == 2; }, other);
+    hashmap.transact({ 3, 20 }, [](Hashmap::Transaction& transaction)
+    {
+        transaction.erase(0);
+        transaction.insert(1, "transacted");
+    });
+    hashmap.combiningInsert(1, "combined");
+
+    ASSERT_EQ(9, hashmap.size());
+    ASSERT_EQ(3, other.size());
+    ASSERT_EQ("again", hashmap.getCopy(4));
+    ASSERT_EQ("combined", hashmap.getCopy(1));
+    ASSERT_EQ("transacted", hashmap.getCopy(20));
+    ASSERT_FALSE(hashmap.find(3));
+
+    hashmap.clear();
+    ASSERT_TRUE(hashmap.insert(1, std::move(handle.value())));
+    ASSERT_EQ(std::string(40, 'b'), hashmap.getCopy(1));
+}
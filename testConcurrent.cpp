@@ -1,8 +1,10 @@
 #include "ConcurrentHashMap.h"
+#include "LockPolicies.h"
 #include "testHelpers.h"
 
 #include <gtest/gtest.h>
 #include <chrono>
+#include <string>
 #include <thread>
 #include <vector>
 
@@ -42,6 +44,26 @@ namespace
         };
     }
 
+    template<class Hashmap>
+    HashmapFunction createCombiningInserter(Hashmap& hashmap, int count)
+    {
+        return [&hashmap, count](int threadIndex)
+        {
+            for (int i = 0; i < count; ++i)
+                hashmap.combiningInsert(threadIndex * count + i, i * i);
+        };
+    }
+
+    template<class Hashmap>
+    HashmapFunction createCombiningEraser(Hashmap& hashmap, int count)
+    {
+        return [&hashmap, count](int threadIndex)
+        {
+            for (int i = 0; i < count; ++i)
+                hashmap.combiningErase(threadIndex * count + i);
+        };
+    }
+
     template<class Hashmap>
     HashmapFunction createGetter(Hashmap& hashmap, int count)
     {
@@ -242,3 +264,444 @@ TEST_F(ConcurrentHashmapEqualHashTest, DeletesAndReadsConcurrentlyValuesWithEqua
         ASSERT_FALSE(hashmap.find(i));
     }
 }
+
+template<class LockPolicy>
+class ConcurrentHashmapLockPolicyTest : public Test
+{
+public:
+    ConcurrentHashmapLockPolicyTest() : hashmap(Capacity, ConcurrencyLevel) {}
+
+protected:
+    static const int Capacity = 1000;
+    static const int ConcurrencyLevel = 4;
+    static const int ThreadNumber = 8;
+    static const int ValuesPerThread = 2000;
+    static const int TotalValues = ThreadNumber * ValuesPerThread;
+    ConcurrentHashmap<int, int, std::hash<int>, LockPolicy> hashmap;
+    std::vector<std::thread> threads;
+};
+
+template<class LockPolicy>
+const int ConcurrentHashmapLockPolicyTest<LockPolicy>::TotalValues;
+
+// Moves amounts between random pairs of the first accountCount keys, each holding initialBalance at start.
+template<class Hashmap>
+void transferConcurrently(Hashmap& hashmap, int accountCount, int initialBalance, int threadNumber, int transfersPerThread)
+{
+    typedef typename Hashmap::Transaction Transaction;
+    for (int account = 0; account < accountCount; ++account)
+        hashmap.insert(account, initialBalance);
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < threadNumber; ++i)
+    {
+        threads.push_back(std::thread([&hashmap, accountCount, transfersPerThread, i]
+        {
+            for (int j = 0; j < transfersPerThread; ++j)
+            {
+                const int from = (i * 7 + j * 13) % accountCount;
+                const int to = (i * 5 + j * 3 + 1) % accountCount;
+                hashmap.transact({ from, to }, [](Transaction& transaction)
+                {
+                    if (transaction.get(0) > 0)
+                    {
+                        --transaction.get(0);
+                        ++transaction.get(1);
+                    }
+                });
+                // plain operations in between may split stripes under the transactions
+                hashmap.find(from);
+            }
+        }));
+    }
+    for (std::thread& t : threads)
+        t.join();
+
+    int total = 0;
+    for (int account = 0; account < accountCount; ++account)
+        total += hashmap.getCopy(account);
+    ASSERT_EQ(accountCount * initialBalance, total);
+}
+
+typedef Types<std::mutex, SpinLock, TicketLock, McsLock, AdaptiveLock, BucketBitLock> LockPolicyTypes;
+TYPED_TEST_CASE(ConcurrentHashmapLockPolicyTest, LockPolicyTypes);
+
+TYPED_TEST(ConcurrentHashmapLockPolicyTest, CombinesInsertsAndDeletesConcurrently)
+{
+    for (int i = 0; i < TestFixture::ThreadNumber; ++i)
+    {
+        this->threads.push_back(std::thread([this, i]
+        {
+            createCombiningInserter(this->hashmap, TestFixture::ValuesPerThread)(i);
+            createCombiningEraser(this->hashmap, TestFixture::ValuesPerThread / 2)(2 * i);
+        }));
+    }
+    for (std::thread& t : this->threads)
+        t.join();
+
+    ASSERT_EQ(TestFixture::TotalValues / 2, this->hashmap.size());
+    for (int i = 0; i < TestFixture::TotalValues; ++i)
+        ASSERT_EQ(i % TestFixture::ValuesPerThread >= TestFixture::ValuesPerThread / 2, this->hashmap.find(i));
+}
+
+TYPED_TEST(ConcurrentHashmapLockPolicyTest, BulkWritesConcurrently)
+{
+    typedef ConcurrentHashmap<int, int, std::hash<int>, TypeParam> Hashmap;
+    for (int i = 0; i < TestFixture::ThreadNumber; ++i)
+    {
+        this->threads.push_back(std::thread([this, i]
+        {
+            typename Hashmap::BulkWriter writer(this->hashmap, 64);
+            for (int j = 0; j < TestFixture::ValuesPerThread; ++j)
+                writer.insert(i * TestFixture::ValuesPerThread + j, j);
+        }));
+    }
+    for (std::thread& t : this->threads)
+        t.join();
+
+    ASSERT_EQ(TestFixture::TotalValues, this->hashmap.size());
+    for (int i = 0; i < TestFixture::TotalValues; ++i)
+        ASSERT_EQ(i % TestFixture::ValuesPerThread, this->hashmap.getCopy(i));
+}
+
+TYPED_TEST(ConcurrentHashmapLockPolicyTest, BulkLoadsWhileOthersInsert)
+{
+    std::vector<std::pair<int, int>> values;
+    for (int i = 0; i < TestFixture::TotalValues / 2; ++i)
+        values.push_back(std::make_pair(i, i % TestFixture::ValuesPerThread));
+
+    for (int i = TestFixture::ThreadNumber / 2; i < TestFixture::ThreadNumber; ++i)
+        this->threads.push_back(std::thread(createInserter(this->hashmap, TestFixture::ValuesPerThread), i));
+    this->hashmap.bulkLoad(values.begin(), values.end(), 4);
+    for (std::thread& t : this->threads)
+        t.join();
+    this->threads.clear();
+
+    ASSERT_EQ(TestFixture::TotalValues, this->hashmap.size());
+    for (int i = 0; i < TestFixture::TotalValues / 2; ++i)
+        ASSERT_EQ(i % TestFixture::ValuesPerThread, this->hashmap.getCopy(i));
+
+    for (int i = 0; i < TestFixture::ThreadNumber; ++i)
+        this->threads.push_back(std::thread(createEraser(this->hashmap, TestFixture::ValuesPerThread), i));
+    for (std::thread& t : this->threads)
+        t.join();
+
+    ASSERT_EQ(0, this->hashmap.size());
+}
+
+TYPED_TEST(ConcurrentHashmapLockPolicyTest, InsertsAndDeletesConcurrently)
+{
+    for (int i = 0; i < TestFixture::ThreadNumber; ++i)
+        this->threads.push_back(std::thread(createInserter(this->hashmap, TestFixture::ValuesPerThread), i));
+    for (std::thread& t : this->threads)
+        t.join();
+    this->threads.clear();
+
+    ASSERT_EQ(TestFixture::TotalValues, this->hashmap.size());
+
+    for (int i = 0; i < TestFixture::ThreadNumber; ++i)
+    {
+        this->threads.push_back(std::thread(createFinder(this->hashmap, TestFixture::ValuesPerThread), i));
+        this->threads.push_back(std::thread(createEraser(this->hashmap, TestFixture::ValuesPerThread), i));
+        this->threads.push_back(std::thread(createGetter(this->hashmap, TestFixture::ValuesPerThread), i));
+    }
+    for (std::thread& t : this->threads)
+        t.join();
+
+    ASSERT_EQ(0, this->hashmap.size());
+}
+
+TYPED_TEST(ConcurrentHashmapLockPolicyTest, TransfersBetweenKeysAtomically)
+{
+    transferConcurrently(this->hashmap, 50, 10, TestFixture::ThreadNumber, TestFixture::ValuesPerThread);
+}
+
+TYPED_TEST(ConcurrentHashmapLockPolicyTest, ClearsWhileOthersInsertAndErase)
+{
+    ConcurrentHashmap<int, int, std::hash<int>, TypeParam, ClearablePolicy> hashmap(TestFixture::Capacity, TestFixture::ConcurrencyLevel);
+    for (int i = 0; i < TestFixture::ThreadNumber; ++i)
+    {
+        this->threads.push_back(std::thread([&hashmap, i]
+        {
+            createInserter(hashmap, TestFixture::ValuesPerThread)(i);
+            createEraser(hashmap, TestFixture::ValuesPerThread / 2)(2 * i);
+        }));
+    }
+    this->threads.push_back(std::thread([&hashmap]
+    {
+        for (int round = 0; round < 20; ++round)
+        {
+            hashmap.clear();
+            if (round % 4 == 0)
+                hashmap.reclaim();
+            std::this_thread::yield();
+        }
+    }));
+    for (std::thread& t : this->threads)
+        t.join();
+
+    // the size keeps counting exactly the keys inserted after the last clear
+    std::size_t visited = 0;
+    hashmap.forEach([&visited](int, int) { ++visited; });
+    ASSERT_EQ(visited, hashmap.size());
+
+    hashmap.clear();
+    hashmap.insert(0, 0);
+    ASSERT_EQ(1, hashmap.size());
+}
+
+class ConcurrentHashmapStripeMappingTest : public TestWithParam<StripeMapping>
+{
+public:
+    ConcurrentHashmapStripeMappingTest() : hashmap(Capacity, ConcurrencyLevel, std::hash<int>(), GetParam()) {}
+
+protected:
+    static const int Capacity = 1000;
+    static const int ConcurrencyLevel = 7;
+    static const int ThreadNumber = 8;
+    static const int ValuesPerThread = 1000;
+    ConcurrentHashmap<int, int> hashmap;
+    std::vector<std::thread> threads;
+};
+
+TEST_P(ConcurrentHashmapStripeMappingTest, InsertsAndDeletesConcurrently)
+{
+    for (int i = 0; i < ThreadNumber; ++i)
+        threads.push_back(std::thread(createInserter(hashmap, ValuesPerThread), i));
+    for (std::thread& t : threads)
+        t.join();
+    threads.clear();
+
+    for (int i = 0; i < ThreadNumber * ValuesPerThread; ++i)
+        ASSERT_TRUE(hashmap.find(i));
+
+    for (int i = 0; i < ThreadNumber; ++i)
+        threads.push_back(std::thread(createEraser(hashmap, ValuesPerThread), i));
+    for (std::thread& t : threads)
+        t.join();
+
+    ASSERT_EQ(0, hashmap.size());
+}
+
+INSTANTIATE_TEST_CASE_P(StripeMappings, ConcurrentHashmapStripeMappingTest,
+    Values(StripeMapping::Contiguous, StripeMapping::Interleaved, StripeMapping::Hashed));
+
+TEST(ConcurrentHashmapStripeSplitTest, SplitsContendedStripe)
+{
+    ConcurrentHashmap<int, int> hashmap(64, 1);
+    hashmap.setStripeSplitThreshold(1);
+    hashmap.insert(1, 1);
+
+    ConcurrentHashmap<int, int>::LockedValue lockedValue = hashmap.get(1);
+    std::thread finder([&hashmap] { ASSERT_FALSE(hashmap.find(2)); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    lockedValue.second.unlock();
+    finder.join();
+
+    ASSERT_EQ(4, hashmap.stripeCount());
+    ASSERT_TRUE(hashmap.find(1));
+}
+
+TEST(ConcurrentHashmapStripeSplitTest, StaysConsistentWhileSplitting)
+{
+    const int threadNumber = 16;
+    const int valuesPerThread = 2000;
+    ConcurrentHashmap<int, int, std::hash<int>, SpinLock> hashmap(4096, 1);
+    hashmap.setStripeSplitThreshold(1);
+    std::vector<std::thread> threads;
+
+    for (int i = 0; i < threadNumber; ++i)
+    {
+        threads.push_back(std::thread([&hashmap, i]
+        {
+            createInserter(hashmap, valuesPerThread)(i);
+            createFinder(hashmap, valuesPerThread)(i);
+            createEraser(hashmap, valuesPerThread)(i);
+            createInserter(hashmap, valuesPerThread)(i);
+        }));
+    }
+    for (std::thread& t : threads)
+        t.join();
+
+    ASSERT_EQ(threadNumber * valuesPerThread, hashmap.size());
+    for (int i = 0; i < threadNumber * valuesPerThread; ++i)
+        ASSERT_TRUE(hashmap.find(i));
+}
+
+TEST(ConcurrentHashmapStripeSplitTest, TransfersAtomicallyWhileSplitting)
+{
+    ConcurrentHashmap<int, int, std::hash<int>, SpinLock> hashmap(4096, 1);
+    hashmap.setStripeSplitThreshold(1);
+
+    transferConcurrently(hashmap, 4096, 3, 16, 2000);
+}
+
+TEST(ConcurrentHashmapSpliceTest, MovesEntriesBetweenMapsConcurrently)
+{
+    const int keyRange = 20000;
+    const int threadNumber = 4;
+    ConcurrentHashmap<int, int> first(1000);
+    ConcurrentHashmap<int, int> second(3000, 7);
+    for (int i = 0; i < keyRange; ++i)
+        first.insert(i, i);
+    std::vector<std::thread> threads;
+
+    for (int i = 0; i < threadNumber; ++i)
+    {
+        threads.push_back(std::thread([&first, &second, i]
+        {
+            for (int round = 0; round < 3; ++round)
+            {
+                if (i == 0)
+                {
+                    first.moveAll([](int key, int) { return key % 2 == 0; }, second);
+                    continue;
+                }
+                for (int key = i; key < keyRange; key += threadNumber)
+                    first.insert(second.extract(key));
+            }
+        }));
+    }
+    for (std::thread& t : threads)
+        t.join();
+
+    ASSERT_EQ(keyRange, first.size() + second.size());
+    for (int i = 0; i < keyRange; ++i)
+    {
+        ASSERT_NE(first.find(i), second.find(i));
+        ASSERT_EQ(i, first.find(i) ? first.getCopy(i) : second.getCopy(i));
+    }
+}
+
+TEST(VersionedHashmapTest, IncrementsWithCompareAndSetConcurrently)
+{
+    const int threadNumber = 8;
+    const int incrementsPerThread = 2000;
+    const int keys = 4;
+    ConcurrentHashmap<int, int, std::hash<int>, std::mutex, VersionedPolicy> hashmap(16);
+    for (int key = 0; key < keys; ++key)
+        hashmap.insert(key, 0);
+    std::vector<std::thread> threads;
+
+    for (int i = 0; i < threadNumber; ++i)
+    {
+        threads.push_back(std::thread([&hashmap]
+        {
+            for (int j = 0; j < incrementsPerThread; ++j)
+            {
+                std::pair<int, std::uint64_t> read;
+                do
+                {
+                    read = hashmap.getVersioned(j % keys);
+                }
+                while (!hashmap.compareAndSet(j % keys, read.second, read.first + 1));
+            }
+        }));
+    }
+    for (std::thread& t : threads)
+        t.join();
+
+    for (int key = 0; key < keys; ++key)
+        ASSERT_EQ(threadNumber * incrementsPerThread / keys, hashmap.getCopy(key));
+}
+
+TEST(InlineFirstNodeHashmapTest, ReusesBucketSlotsConcurrently)
+{
+    const int threadNumber = 4;
+    const int keysPerThread = 500;
+    ConcurrentHashmap<int, std::string, std::hash<int>, BucketBitLock, InlineFirstNodePolicy> hashmap(64);
+    std::vector<std::thread> threads;
+
+    // keys of all threads share the buckets, so slots are taken, freed and reused under contention
+    for (int i = 0; i < threadNumber; ++i)
+    {
+        threads.push_back(std::thread([&hashmap, i]
+        {
+            for (int round = 0; round < 4; ++round)
+            {
+                for (int j = 0; j < keysPerThread; ++j)
+                    hashmap.insert(j * threadNumber + i, std::to_string(j));
+                for (int j = 0; j < keysPerThread; ++j)
+                    ASSERT_EQ(std::to_string(j), hashmap.getCopy(j * threadNumber + i));
+                for (int j = round % 2; j < keysPerThread; j += 2)
+                    hashmap.erase(j * threadNumber + i);
+            }
+        }));
+    }
+    for (std::thread& t : threads)
+        t.join();
+
+    ASSERT_EQ(threadNumber * keysPerThread / 2, hashmap.size());
+    for (int key = 0; key < threadNumber * keysPerThread; ++key)
+        ASSERT_EQ(key / threadNumber % 2 == 0, hashmap.find(key));
+}
+
+TEST(SortedChainsHashmapTest, KeepsLongChainsConsistentUnderConcurrentWrites)
+{
+    const int threadNumber = 4;
+    const int keysPerThread = 1000;
+    ConcurrentHashmap<int, int, std::hash<int>, std::mutex, SortedChainsPolicy> hashmap(8, 4);
+    std::vector<std::thread> threads;
+
+    // about 500 keys per bucket, inserted from both ends of every thread's range so that most links go mid-chain
+    for (int i = 0; i < threadNumber; ++i)
+    {
+        threads.push_back(std::thread([&hashmap, i]
+        {
+            for (int j = 0; j < keysPerThread / 2; ++j)
+            {
+                hashmap.insert(j * threadNumber + i, j);
+                hashmap.insert((keysPerThread - 1 - j) * threadNumber + i, j);
+            }
+            for (int j = 0; j < keysPerThread; j += 2)
+                ASSERT_TRUE(hashmap.erase(j * threadNumber + i));
+            for (int j = 1; j < keysPerThread; j += 2)
+                ASSERT_TRUE(hashmap.find(j * threadNumber + i));
+        }));
+    }
+    for (std::thread& t : threads)
+        t.join();
+
+    ASSERT_EQ(threadNumber * keysPerThread / 2, hashmap.size());
+    for (int key = 0; key < threadNumber * keysPerThread; ++key)
+        ASSERT_EQ(key / threadNumber % 2 == 1, hashmap.find(key));
+}
+
+TEST(InsertOnlyHashmapTest, ReadsWithoutLocksWhileInserting)
+{
+    const int writerNumber = 4;
+    const int valuesPerThread = 5000;
+    const int capacity = 1000;
+    ConcurrentHashmap<int, int, std::hash<int>, BucketBitLock, InsertOnlyPolicy> hashmap(capacity);
+    std::vector<std::thread> threads;
+
+    for (int i = 0; i < writerNumber; ++i)
+    {
+        threads.push_back(std::thread([&hashmap, i]
+        {
+            for (int j = 0; j < valuesPerThread; ++j)
+                hashmap.insert(i * valuesPerThread + j, j);
+            // overwrites replace nodes that readers may be standing on
+            for (int j = 0; j < valuesPerThread; ++j)
+                hashmap.insert(i * valuesPerThread + j, j + 1);
+        }));
+        threads.push_back(std::thread([&hashmap, i]
+        {
+            for (int j = 0; j < valuesPerThread; ++j)
+            {
+                try
+                {
+                    const int value = hashmap.getCopy(i * valuesPerThread + j);
+                    ASSERT_TRUE(value == j || value == j + 1);
+                }
+                catch (const ConcurrentHashmapException&) {}
+            }
+        }));
+    }
+    for (std::thread& t : threads)
+        t.join();
+
+    ASSERT_EQ(writerNumber * valuesPerThread, hashmap.size());
+    for (int i = 0; i < writerNumber * valuesPerThread; ++i)
+        ASSERT_EQ(i % valuesPerThread + 1, hashmap.getCopy(i));
+}
@@ -0,0 +1,68 @@
+#include "ConcurrentCounterMap.h"
+
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace testing;
+
+class ConcurrentCounterMapTest : public Test
+{
+public:
+    ConcurrentCounterMapTest() : counters(Capacity) {}
+
+protected:
+    static const std::size_t Capacity;
+    ConcurrentCounterMap<std::string> counters;
+    std::vector<std::thread> threads;
+};
+
+const std::size_t ConcurrentCounterMapTest::Capacity = 100;
+
+TEST_F(ConcurrentCounterMapTest, CreatesCountersOnFirstIncrement)
+{
+    ASSERT_FALSE(counters.find("requests"));
+    ASSERT_THROW(counters.getCopy("requests"), ConcurrentHashmapException);
+
+    counters.increment("requests");
+    counters.increment("requests", 4);
+    counters.increment("errors", -1);
+
+    ASSERT_EQ(2, counters.size());
+    ASSERT_EQ(5, counters.getCopy("requests"));
+    ASSERT_EQ(-1, counters.getCopy("errors"));
+}
+
+TEST_F(ConcurrentCounterMapTest, SpreadCounterKeepsValue)
+{
+    counters.increment("requests", 3);
+    counters.spreadCounter("requests");
+    counters.spreadCounter("requests");
+    counters.increment("requests", 2);
+
+    ASSERT_EQ(5, counters.getCopy("requests"));
+}
+
+TEST_F(ConcurrentCounterMapTest, IncrementsConcurrently)
+{
+    const int threadNumber = 8;
+    const int keys = 50;
+    const int rounds = 500;
+    counters.spreadCounter("key0");
+    for (int i = 0; i < threadNumber; ++i)
+    {
+        threads.push_back(std::thread([this]
+        {
+            for (int round = 0; round < rounds; ++round)
+                for (int key = 0; key < keys; ++key)
+                    counters.increment("key" + std::to_string(key));
+        }));
+    }
+    for (std::thread& t : threads)
+        t.join();
+
+    ASSERT_EQ(keys, counters.size());
+    for (int key = 0; key < keys; ++key)
+        ASSERT_EQ(threadNumber * rounds, counters.getCopy("key" + std::to_string(key)));
+}
@@ -0,0 +1,107 @@
+#include "ConcurrentFlatHashmap.h"
+
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+using namespace testing;
+
+class ConcurrentFlatHashmapTest : public Test
+{
+public:
+    ConcurrentFlatHashmapTest() : hashmap(Capacity) {}
+
+protected:
+    static const std::size_t Capacity;
+    ConcurrentFlatHashmap<std::uint64_t, std::uint64_t> hashmap;
+    std::vector<std::thread> threads;
+};
+
+const std::size_t ConcurrentFlatHashmapTest::Capacity = 100000;
+
+TEST_F(ConcurrentFlatHashmapTest, InsertsFindsAndErases)
+{
+    hashmap.insert(1, 10);
+    hashmap.insert(2, 20);
+    hashmap.insert(1, 11);
+
+    ASSERT_EQ(2, hashmap.size());
+    ASSERT_EQ(11, hashmap.getCopy(1));
+
+    hashmap.erase(1);
+    hashmap.erase(3);
+
+    ASSERT_EQ(1, hashmap.size());
+    ASSERT_FALSE(hashmap.find(1));
+    ASSERT_THROW(hashmap.getCopy(1), ConcurrentHashmapException);
+
+    hashmap.insert(1, 12);
+
+    ASSERT_EQ(12, hashmap.getCopy(1));
+}
+
+TEST_F(ConcurrentFlatHashmapTest, RoundsCapacityToPowerOfTwo)
+{
+    ASSERT_EQ(262144, hashmap.capacity());
+}
+
+TEST_F(ConcurrentFlatHashmapTest, ThrowsOnReservedKeyAndValue)
+{
+    ASSERT_THROW(hashmap.insert(~0ull, 1), ConcurrentHashmapException);
+    ASSERT_THROW(hashmap.insert(1, ~0ull), ConcurrentHashmapException);
+    ASSERT_EQ(0, hashmap.size());
+}
+
+TEST(ConcurrentFlatHashmapFullTest, ThrowsWhenSlotsRunOut)
+{
+    ConcurrentFlatHashmap<int, int> hashmap(3);
+    for (std::size_t i = 0; i < hashmap.capacity(); ++i)
+        hashmap.insert(static_cast<int>(i), 0);
+
+    ASSERT_THROW(hashmap.insert(static_cast<int>(hashmap.capacity()), 0), ConcurrentHashmapException);
+}
+
+TEST_F(ConcurrentFlatHashmapTest, FetchAddsConcurrently)
+{
+    const int threadNumber = 8;
+    const int keys = 100;
+    const int rounds = 1000;
+    for (int i = 0; i < threadNumber; ++i)
+    {
+        threads.push_back(std::thread([this]
+        {
+            for (int round = 0; round < rounds; ++round)
+                for (int key = 0; key < keys; ++key)
+                    hashmap.fetchAdd(key, 1);
+        }));
+    }
+    for (std::thread& t : threads)
+        t.join();
+
+    ASSERT_EQ(keys, hashmap.size());
+    for (int key = 0; key < keys; ++key)
+        ASSERT_EQ(threadNumber * rounds, hashmap.getCopy(key));
+}
+
+TEST_F(ConcurrentFlatHashmapTest, InsertsAndErasesConcurrently)
+{
+    const int threadNumber = 8;
+    const int valuesPerThread = 5000;
+    for (int i = 0; i < threadNumber; ++i)
+    {
+        threads.push_back(std::thread([this, i]
+        {
+            for (int j = 0; j < valuesPerThread; ++j)
+                hashmap.insert(i * valuesPerThread + j, j);
+            for (int j = 0; j < valuesPerThread; j += 2)
+                hashmap.erase(i * valuesPerThread + j);
+        }));
+    }
+    for (std::thread& t : threads)
+        t.join();
+
+    ASSERT_EQ(threadNumber * valuesPerThread / 2, hashmap.size());
+    for (int i = 0; i < threadNumber * valuesPerThread; ++i)
+        ASSERT_EQ(i % 2 == 1, hashmap.find(i));
+}
@@ -0,0 +1,96 @@
+#include "ConcurrentHashset.h"
+
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+using namespace testing;
+
+template<class Hashset>
+class ConcurrentHashsetTest : public Test
+{
+public:
+    ConcurrentHashsetTest() : hashset(Capacity, ConcurrencyLevel) {}
+
+protected:
+    static const int Capacity = 64;
+    static const int ConcurrencyLevel = 4;
+    Hashset hashset;
+    std::vector<std::thread> threads;
+};
+
+typedef Types<ChainedConcurrentHashset<int>, DenseConcurrentHashset<int>, ConcurrentHashset<int, std::hash<int>, BucketBitLock>> HashsetTypes;
+TYPED_TEST_CASE(ConcurrentHashsetTest, HashsetTypes);
+
+TYPED_TEST(ConcurrentHashsetTest, InsertsContainsAndErases)
+{
+    ASSERT_TRUE(this->hashset.insert(1));
+    ASSERT_TRUE(this->hashset.insert(2));
+    ASSERT_FALSE(this->hashset.insert(1));
+
+    ASSERT_EQ(2, this->hashset.size());
+    ASSERT_TRUE(this->hashset.contains(1));
+    ASSERT_FALSE(this->hashset.contains(3));
+
+    ASSERT_TRUE(this->hashset.erase(1));
+    ASSERT_FALSE(this->hashset.erase(1));
+
+    ASSERT_EQ(1, this->hashset.size());
+    ASSERT_FALSE(this->hashset.contains(1));
+    ASSERT_TRUE(this->hashset.insert(1));
+}
+
+TYPED_TEST(ConcurrentHashsetTest, TestsBatchMembership)
+{
+    for (int i = 0; i < 1000; i += 3)
+        this->hashset.insert(i);
+
+    std::vector<int> keys;
+    for (int i = 999; i >= 0; --i)
+        keys.push_back(i);
+    std::vector<bool> results;
+    this->hashset.containsAll(keys.begin(), keys.end(), std::back_inserter(results));
+
+    ASSERT_EQ(keys.size(), results.size());
+    for (std::size_t i = 0; i < keys.size(); ++i)
+        ASSERT_EQ(keys[i] % 3 == 0, results[i]);
+}
+
+TYPED_TEST(ConcurrentHashsetTest, InsertsAndErasesConcurrently)
+{
+    const int threadNumber = 8;
+    const int valuesPerThread = 2000;
+    for (int i = 0; i < threadNumber; ++i)
+    {
+        this->threads.push_back(std::thread([this, i]
+        {
+            for (int j = 0; j < valuesPerThread; ++j)
+                ASSERT_TRUE(this->hashset.insert(i * valuesPerThread + j));
+            for (int j = 0; j < valuesPerThread; j += 2)
+                ASSERT_TRUE(this->hashset.erase(i * valuesPerThread + j));
+        }));
+    }
+    for (std::thread& t : this->threads)
+        t.join();
+
+    ASSERT_EQ(threadNumber * valuesPerThread / 2, this->hashset.size());
+    for (int i = 0; i < threadNumber * valuesPerThread; ++i)
+        ASSERT_EQ(i % 2 == 1, this->hashset.contains(i));
+}
+
+TEST(ConcurrentHashsetLayoutTest, PicksDenseLayoutForSmallTriviallyCopyableKeys)
+{
+    ASSERT_TRUE((std::is_same<DenseConcurrentHashset<long>, ConcurrentHashset<long>>::value));
+    ASSERT_TRUE((std::is_same<ChainedConcurrentHashset<std::string>, ConcurrentHashset<std::string>>::value));
+}
+
+TEST(ConcurrentHashsetLayoutTest, ChainedSetWorksWithStrings)
+{
+    ConcurrentHashset<std::string> hashset(10);
+
+    ASSERT_TRUE(hashset.insert("a"));
+    ASSERT_FALSE(hashset.insert("a"));
+    ASSERT_TRUE(hashset.contains("a"));
+}
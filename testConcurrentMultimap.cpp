@@ -0,0 +1,74 @@
+#include "ConcurrentMultimap.h"
+
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace testing;
+
+class ConcurrentMultimapTest : public Test
+{
+public:
+    ConcurrentMultimapTest() : multimap(Capacity) {}
+
+protected:
+    static const std::size_t Capacity;
+    ConcurrentMultimap<std::string, int> multimap;
+    std::vector<std::thread> threads;
+};
+
+const std::size_t ConcurrentMultimapTest::Capacity = 100;
+
+TEST_F(ConcurrentMultimapTest, AppendsAndVisitsValuesInOrder)
+{
+    multimap.append("alice", 1);
+    multimap.append("alice", 2);
+    multimap.append("bob", 3);
+
+    std::vector<int> values;
+    multimap.forEachValue("alice", [&values](int value) { values.push_back(value); });
+
+    ASSERT_EQ(2, multimap.size());
+    ASSERT_EQ(std::vector<int>({ 1, 2 }), values);
+    ASSERT_EQ(1, multimap.count("bob"));
+    ASSERT_EQ(0, multimap.count("carol"));
+}
+
+TEST_F(ConcurrentMultimapTest, ErasesValuesAndEmptyKeys)
+{
+    multimap.append("alice", 1);
+    multimap.append("alice", 2);
+    multimap.append("alice", 3);
+
+    ASSERT_EQ(2, multimap.eraseValue("alice", [](int value) { return value % 2 == 1; }));
+    ASSERT_EQ(1, multimap.count("alice"));
+    ASSERT_EQ(0, multimap.eraseValue("carol", [](int) { return true; }));
+
+    ASSERT_EQ(1, multimap.eraseValue("alice", [](int) { return true; }));
+    ASSERT_FALSE(multimap.find("alice"));
+    ASSERT_EQ(0, multimap.size());
+}
+
+TEST_F(ConcurrentMultimapTest, AppendsConcurrently)
+{
+    const int threadNumber = 8;
+    const int valuesPerThread = 1000;
+    const int keys = 10;
+    for (int i = 0; i < threadNumber; ++i)
+    {
+        threads.push_back(std::thread([this, i]
+        {
+            for (int j = 0; j < valuesPerThread; ++j)
+                multimap.append(std::to_string(j % keys), i);
+            for (int j = 0; j < keys; ++j)
+                multimap.eraseValue(std::to_string(j), [i](int value) { return value == i && i % 2 == 0; });
+        }));
+    }
+    for (std::thread& t : threads)
+        t.join();
+
+    ASSERT_EQ(keys, multimap.size());
+    for (int j = 0; j < keys; ++j)
+        ASSERT_EQ(threadNumber / 2 * valuesPerThread / keys, multimap.count(std::to_string(j)));
+}
@@ -0,0 +1,109 @@
+#include "ConcurrentOrderedMap.h"
+
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace testing;
+
+class ConcurrentOrderedMapTest : public Test
+{
+protected:
+    ConcurrentOrderedMap<std::string, int> map;
+    std::vector<std::thread> threads;
+};
+
+TEST_F(ConcurrentOrderedMapTest, InsertsFindsAndErases)
+{
+    ASSERT_TRUE(map.insert("b", 2));
+    ASSERT_TRUE(map.insert("a", 1));
+    ASSERT_FALSE(map.insert("b", 3));
+
+    ASSERT_EQ(2, map.size());
+    ASSERT_TRUE(map.find("a"));
+    ASSERT_FALSE(map.find("c"));
+    ASSERT_EQ(3, map.getCopy("b"));
+    ASSERT_THROW(map.getCopy("c"), ConcurrentHashmapException);
+
+    ASSERT_TRUE(map.erase("a"));
+    ASSERT_FALSE(map.erase("a"));
+    ASSERT_FALSE(map.find("a"));
+    ASSERT_EQ(1, map.size());
+}
+
+TEST_F(ConcurrentOrderedMapTest, FindsLowerBound)
+{
+    map.insert("b", 2);
+    map.insert("d", 4);
+
+    std::string key;
+    int value = 0;
+    ASSERT_TRUE(map.lowerBound("a", key, value));
+    ASSERT_EQ("b", key);
+    ASSERT_EQ(2, value);
+    ASSERT_TRUE(map.lowerBound("d", key, value));
+    ASSERT_EQ("d", key);
+    ASSERT_FALSE(map.lowerBound("e", key, value));
+}
+
+TEST_F(ConcurrentOrderedMapTest, ScansRangesAndPrefixesInOrder)
+{
+    const char* keys[] = { "user:3", "order:1", "user:1", "user:22", "zone:1", "user:2" };
+    for (int i = 0; i < 6; ++i)
+        map.insert(keys[i], i);
+
+    std::vector<std::string> scanned;
+    map.rangeScan("order:1", "user:22", [&scanned](const std::string& key, int) { scanned.push_back(key); });
+    ASSERT_EQ(std::vector<std::string>({ "order:1", "user:1", "user:2" }), scanned);
+
+    std::vector<std::pair<std::string, int>> prefixed;
+    map.prefixScan("user:2", [&prefixed](const std::string& key, int value) { prefixed.push_back(std::make_pair(key, value)); });
+    ASSERT_EQ(2, prefixed.size());
+    ASSERT_EQ(std::make_pair(std::string("user:2"), 5), prefixed[0]);
+    ASSERT_EQ(std::make_pair(std::string("user:22"), 3), prefixed[1]);
+}
+
+TEST_F(ConcurrentOrderedMapTest, InsertsAndErasesConcurrently)
+{
+    const int threadNumber = 8;
+    const int keysPerThread = 2000;
+    for (int i = 0; i < threadNumber; ++i)
+    {
+        threads.push_back(std::thread([this, i]
+        {
+            // threads share the keys, so inserts, overwrites and erases of the same key race
+            for (int round = 0; round < 3; ++round)
+            {
+                for (int key = 0; key < keysPerThread; ++key)
+                    map.insert(std::to_string(key), i);
+                for (int key = 0; key < keysPerThread; key += 2)
+                    map.erase(std::to_string(key));
+            }
+            // scans racing with erases still see keys in order
+            std::string previous;
+            map.rangeScan("", "~", [&previous](const std::string& key, int)
+            {
+                ASSERT_LT(previous, key);
+                previous = key;
+            });
+        }));
+    }
+    for (std::thread& t : threads)
+        t.join();
+    for (int key = 0; key < keysPerThread; key += 2)
+        map.erase(std::to_string(key));
+
+    ASSERT_EQ(keysPerThread / 2, map.size());
+    std::string previous;
+    std::size_t scanned = 0;
+    map.rangeScan("", "~", [&previous, &scanned](const std::string& key, int)
+    {
+        ASSERT_LT(previous, key);
+        ASSERT_EQ(1, std::stoi(key) % 2);
+        previous = key;
+        ++scanned;
+    });
+    ASSERT_EQ(keysPerThread / 2, scanned);
+}
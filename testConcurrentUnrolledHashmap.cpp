@@ -0,0 +1,71 @@
+#include "ConcurrentUnrolledHashmap.h"
+
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace testing;
+
+TEST(ConcurrentUnrolledHashmapTest, PacksSeveralEntriesPerChunk)
+{
+    ASSERT_EQ(6, (ConcurrentUnrolledHashmap<int, int>::EntriesPerChunk));
+    ASSERT_EQ(13, (ConcurrentUnrolledHashmap<int, int, std::hash<int>, std::mutex, 128>::EntriesPerChunk));
+    ASSERT_EQ(1, (ConcurrentUnrolledHashmap<std::string, std::string>::EntriesPerChunk));
+}
+
+TEST(ConcurrentUnrolledHashmapTest, InsertsFindsAndErasesAcrossChunks)
+{
+    // a single bucket, so all keys share one chain of several chunks
+    ConcurrentUnrolledHashmap<int, std::string> hashmap(1);
+    for (int i = 0; i < 20; ++i)
+        ASSERT_TRUE(hashmap.insert(i, std::to_string(i)));
+    ASSERT_FALSE(hashmap.insert(7, "seven"));
+
+    ASSERT_EQ(20, hashmap.size());
+    ASSERT_EQ("seven", hashmap.getCopy(7));
+    ASSERT_FALSE(hashmap.find(20));
+    ASSERT_THROW(hashmap.getCopy(20), ConcurrentHashmapException);
+
+    // emptied chunks are freed, holes are refilled by later inserts
+    for (int i = 0; i < 20; i += 2)
+        ASSERT_TRUE(hashmap.erase(i));
+    ASSERT_FALSE(hashmap.erase(0));
+    ASSERT_TRUE(hashmap.insert(100, "100"));
+
+    ASSERT_EQ(11, hashmap.size());
+    int sum = 0;
+    hashmap.forEach([&sum](int key, const std::string& value)
+    {
+        ASSERT_EQ(key == 7 ? "seven" : std::to_string(key), value);
+        sum += key;
+    });
+    ASSERT_EQ(1 + 3 + 5 + 7 + 9 + 11 + 13 + 15 + 17 + 19 + 100, sum);
+}
+
+TEST(ConcurrentUnrolledHashmapTest, InsertsAndErasesConcurrently)
+{
+    const int threadNumber = 8;
+    const int valuesPerThread = 5000;
+    ConcurrentUnrolledHashmap<int, int> hashmap(1000, 8);
+    std::vector<std::thread> threads;
+
+    for (int i = 0; i < threadNumber; ++i)
+    {
+        threads.push_back(std::thread([&hashmap, i]
+        {
+            for (int j = 0; j < valuesPerThread; ++j)
+                hashmap.insert(i * valuesPerThread + j, j);
+            for (int j = 0; j < valuesPerThread; j += 2)
+                hashmap.erase(i * valuesPerThread + j);
+            for (int j = 1; j < valuesPerThread; j += 2)
+                ASSERT_EQ(j, hashmap.getCopy(i * valuesPerThread + j));
+        }));
+    }
+    for (std::thread& t : threads)
+        t.join();
+
+    ASSERT_EQ(threadNumber * valuesPerThread / 2, hashmap.size());
+    for (int i = 0; i < threadNumber * valuesPerThread; ++i)
+        ASSERT_EQ(i % 2 == 1, hashmap.find(i));
+}
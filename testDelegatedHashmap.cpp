@@ -0,0 +1,82 @@
+#include "DelegatedHashmap.h"
+
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace testing;
+
+class DelegatedHashmapTest : public Test
+{
+public:
+    DelegatedHashmapTest() : hashmap(Capacity, ShardCount) {}
+
+protected:
+    static const std::size_t Capacity;
+    static const std::size_t ShardCount;
+    DelegatedHashmap<int, int> hashmap;
+};
+
+const std::size_t DelegatedHashmapTest::Capacity = 1000;
+const std::size_t DelegatedHashmapTest::ShardCount = 4;
+
+TEST_F(DelegatedHashmapTest, ReadsSeeEarlierWritesOfSameThread)
+{
+    hashmap.insert(1, 2);
+    hashmap.insert(3, 4);
+
+    ASSERT_TRUE(hashmap.find(1).get());
+    ASSERT_EQ(4, hashmap.getCopy(3).get());
+
+    hashmap.erase(1);
+    ASSERT_FALSE(hashmap.find(1).get());
+}
+
+TEST_F(DelegatedHashmapTest, GetCopyFutureThrowsIfKeyNotFound)
+{
+    std::future<int> value = hashmap.getCopy(1);
+
+    ASSERT_THROW(value.get(), ConcurrentHashmapException);
+}
+
+TEST_F(DelegatedHashmapTest, FlushWaitsForAllShards)
+{
+    for (int i = 0; i < 1000; ++i)
+        hashmap.insert(i, i);
+
+    hashmap.flush().wait();
+
+    ASSERT_EQ(1000, hashmap.size());
+}
+
+TEST_F(DelegatedHashmapTest, InsertsConcurrently)
+{
+    const int threadNumber = 8;
+    const int valuesPerThread = 1000;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < threadNumber; ++i)
+    {
+        threads.push_back(std::thread([this, i]
+        {
+            for (int j = 0; j < valuesPerThread; ++j)
+                hashmap.insert(i * valuesPerThread + j, j);
+            hashmap.flush().wait();
+        }));
+    }
+    for (std::thread& t : threads)
+        t.join();
+
+    ASSERT_EQ(threadNumber * valuesPerThread, hashmap.size());
+    for (int i = 0; i < threadNumber * valuesPerThread; ++i)
+        ASSERT_EQ(i % valuesPerThread, hashmap.getCopy(i).get());
+}
+
+TEST(DelegatedHashmapStringTest, ExecutesPendingWritesBeforeDestruction)
+{
+    std::unique_ptr<DelegatedHashmap<std::string, std::string>> hashmap(new DelegatedHashmap<std::string, std::string>(100, 2));
+    for (int i = 0; i < 100; ++i)
+        hashmap->insert(std::to_string(i), "value");
+
+    hashmap.reset();
+}
@@ -0,0 +1,79 @@
+#include "FrozenHashmap.h"
+#include "testHelpers.h"
+
+#include <gtest/gtest.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace testing;
+
+TEST(FrozenHashmapTest, FindsEveryFrozenKey)
+{
+    const int count = 10000;
+    ConcurrentHashmap<int, int> hashmap(count);
+    for (int i = 0; i < count; ++i)
+        hashmap.insert(i * 7, i);
+
+    FrozenHashmap<int, int> frozen = freezeToPerfectHash(hashmap);
+
+    ASSERT_EQ(count, frozen.size());
+    for (int i = 0; i < count; ++i)
+        ASSERT_EQ(i, frozen.getCopy(i * 7));
+    ASSERT_FALSE(frozen.find(1));
+    ASSERT_FALSE(frozen.find(count * 7));
+}
+
+TEST(FrozenHashmapTest, WorksWithStringKeys)
+{
+    ConcurrentHashmap<std::string, std::string> hashmap(10);
+    hashmap.insert("a", "1");
+    hashmap.insert("b", "2");
+
+    FrozenHashmap<std::string, std::string> frozen = freezeToPerfectHash(hashmap);
+
+    ASSERT_EQ("1", frozen.get("a"));
+    ASSERT_EQ("2", frozen.get("b"));
+    ASSERT_THROW(frozen.get("c"), ConcurrentHashmapException);
+}
+
+TEST(FrozenHashmapTest, EmptyMapFindsNothing)
+{
+    ConcurrentHashmap<int, int> hashmap(10);
+
+    FrozenHashmap<int, int> frozen = freezeToPerfectHash(hashmap);
+
+    ASSERT_EQ(0, frozen.size());
+    ASSERT_FALSE(frozen.find(1));
+}
+
+TEST(FrozenHashmapTest, FindsKeysWithEqualHashes)
+{
+    std::vector<std::pair<int, int>> entries = { { 1, 1 }, { 2, 2 }, { 3, 3 } };
+
+    FrozenHashmap<int, int, IntHashFunction> frozen(entries, dummyIntHash);
+
+    ASSERT_EQ(3, frozen.size());
+    for (int i = 1; i <= 3; ++i)
+        ASSERT_EQ(i, frozen.getCopy(i));
+    ASSERT_FALSE(frozen.find(4));
+}
+
+TEST(FrozenHashmapTest, FreezesMapWithWeakHasher)
+{
+    const int count = 1000;
+    IntHashFunction lowByte = [](int key) { return static_cast<std::size_t>(key & 0xff); };
+    ConcurrentHashmap<int, int, IntHashFunction> hashmap(count, ConcurrencyLevelDefault, lowByte);
+    for (int i = 0; i < count; ++i)
+        hashmap.insert(i, i * 2);
+
+    FrozenHashmap<int, int, IntHashFunction> frozen = freezeToPerfectHash(hashmap);
+
+    ASSERT_EQ(count, frozen.size());
+    std::size_t visited = 0;
+    frozen.forEach([&visited](int key, int value) { visited += value == key * 2; });
+    ASSERT_EQ(count, visited);
+    for (int i = 0; i < count; ++i)
+        ASSERT_EQ(i * 2, frozen.getCopy(i));
+    ASSERT_FALSE(frozen.find(count));
+}
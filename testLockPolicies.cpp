@@ -0,0 +1,66 @@
+#include "LockPolicies.h"
+
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+using namespace testing;
+
+template<class Lock>
+class LockPolicyTest : public Test
+{
+protected:
+    Lock lock;
+};
+
+typedef Types<SpinLock, TicketLock, McsLock, AdaptiveLock> LockTypes;
+TYPED_TEST_CASE(LockPolicyTest, LockTypes);
+
+TYPED_TEST(LockPolicyTest, TryLockFailsWhileLocked)
+{
+    this->lock.lock();
+    std::thread other([this] { ASSERT_FALSE(this->lock.try_lock()); });
+    other.join();
+    this->lock.unlock();
+
+    ASSERT_TRUE(this->lock.try_lock());
+    this->lock.unlock();
+}
+
+TYPED_TEST(LockPolicyTest, ProvidesMutualExclusion)
+{
+    const int threadNumber = 8;
+    const int iterations = 10000;
+    int counter = 0;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < threadNumber; ++i)
+    {
+        threads.push_back(std::thread([this, &counter]
+        {
+            for (int j = 0; j < iterations; ++j)
+            {
+                std::lock_guard<TypeParam> guard(this->lock);
+                ++counter;
+            }
+        }));
+    }
+    for (std::thread& t : threads)
+        t.join();
+
+    ASSERT_EQ(threadNumber * iterations, counter);
+}
+
+TEST(McsLockTest, SameThreadCanHoldSeveralLocks)
+{
+    McsLock first;
+    McsLock second;
+
+    first.lock();
+    second.lock();
+    ASSERT_FALSE(first.try_lock());
+    second.unlock();
+    first.unlock();
+
+    ASSERT_TRUE(second.try_lock());
+    second.unlock();
+}
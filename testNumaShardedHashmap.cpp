@@ -0,0 +1,81 @@
+#include "NumaShardedHashmap.h"
+#include "testHelpers.h"
+
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+using namespace testing;
+
+class NumaShardedHashmapTest : public Test
+{
+public:
+    NumaShardedHashmapTest() : hashmap(Capacity, 16, std::hash<int>(), ShardCount) {}
+
+protected:
+    static const std::size_t Capacity;
+    static const std::size_t ShardCount;
+    NumaShardedHashmap<int, int> hashmap;
+};
+
+const std::size_t NumaShardedHashmapTest::Capacity = 1000;
+const std::size_t NumaShardedHashmapTest::ShardCount = 4;
+
+TEST_F(NumaShardedHashmapTest, CreatesRequestedNumberOfShards)
+{
+    ASSERT_EQ(ShardCount, hashmap.shardCount());
+    ASSERT_LE(Capacity, hashmap.capacity());
+}
+
+TEST_F(NumaShardedHashmapTest, InsertsFindsAndErases)
+{
+    for (int i = 0; i < 100; ++i)
+        hashmap.insert(i, i * 2);
+
+    ASSERT_EQ(100, hashmap.size());
+    ASSERT_TRUE(hashmap.find(50));
+    ASSERT_EQ(100, hashmap.getCopy(50));
+    ASSERT_EQ(42, hashmap.get(21).first);
+
+    hashmap.erase(50);
+    ASSERT_FALSE(hashmap.find(50));
+    ASSERT_THROW(hashmap.getCopy(50), ConcurrentHashmapException);
+    ASSERT_EQ(99, hashmap.size());
+}
+
+TEST_F(NumaShardedHashmapTest, SpreadsKeysOverShards)
+{
+    std::vector<int> keysPerShard(ShardCount, 0);
+    for (int i = 0; i < 1000; ++i)
+        ++keysPerShard[hashmap.shardOf(i)];
+
+    for (int count : keysPerShard)
+        ASSERT_LT(100, count);
+}
+
+TEST_F(NumaShardedHashmapTest, InsertsConcurrentlyFromBoundThreads)
+{
+    const int threadNumber = 8;
+    const int valuesPerThread = 1000;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < threadNumber; ++i)
+    {
+        threads.push_back(std::thread([this, i]
+        {
+            hashmap.bindCurrentThreadToShard(i % ShardCount);
+            for (int j = 0; j < valuesPerThread; ++j)
+                hashmap.insert(i * valuesPerThread + j, j);
+        }));
+    }
+    for (std::thread& t : threads)
+        t.join();
+
+    ASSERT_EQ(threadNumber * valuesPerThread, hashmap.size());
+}
+
+TEST(InvalidNumaShardedHashmapTest, ThrowsIfInvalidCapacity)
+{
+    std::unique_ptr<NumaShardedHashmap<int, int>> p;
+
+    ASSERT_THROW(p.reset(new NumaShardedHashmap<int, int>(0)), ConcurrentHashmapException);
+}
@@ -0,0 +1,74 @@
+#include "ConcurrentHashMap.h"
+#include "VersionedMapHandle.h"
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace testing;
+
+namespace
+{
+    typedef ConcurrentHashmap<int, int> Hashmap;
+
+    const int KeyCount = 1000;
+
+    // every key maps to the generation
+    std::unique_ptr<Hashmap> buildMap(int generation)
+    {
+        std::unique_ptr<Hashmap> hashmap(new Hashmap(KeyCount));
+        for (int key = 0; key < KeyCount; ++key)
+            hashmap->insert(key, generation);
+        return hashmap;
+    }
+}
+
+TEST(VersionedMapHandleTest, ReadsPublishedMap)
+{
+    VersionedMapHandle<Hashmap> handle(buildMap(0));
+    ASSERT_EQ(0, handle.read([](const Hashmap& hashmap) { return hashmap.getCopy(1); }));
+    ASSERT_EQ(0, handle.version());
+
+    std::unique_ptr<Hashmap> old = handle.publish(buildMap(1));
+    ASSERT_EQ(0, old->getCopy(1));
+    ASSERT_EQ(1, handle.read([](const Hashmap& hashmap) { return hashmap.getCopy(1); }));
+    ASSERT_EQ(1, handle.version());
+}
+
+TEST(VersionedMapHandleTest, ReadersSeeWholeMapsWhilePublishing)
+{
+    const int readerNumber = 4;
+    const int publications = 50;
+    VersionedMapHandle<Hashmap> handle(buildMap(0));
+    std::atomic<bool> done(false);
+    std::vector<std::thread> readers;
+
+    for (int i = 0; i < readerNumber; ++i)
+    {
+        readers.push_back(std::thread([&handle, &done, i]
+        {
+            int lastGeneration = 0;
+            while (!done)
+            {
+                handle.read([&lastGeneration, i](const Hashmap& hashmap)
+                {
+                    const int generation = hashmap.getCopy(i);
+                    ASSERT_LE(lastGeneration, generation);
+                    ASSERT_EQ(KeyCount, hashmap.size());
+                    ASSERT_EQ(generation, hashmap.getCopy(KeyCount - 1 - i));
+                    lastGeneration = generation;
+                });
+            }
+        }));
+    }
+
+    for (int generation = 1; generation <= publications; ++generation)
+        handle.publish(buildMap(generation));
+    done = true;
+    for (std::thread& t : readers)
+        t.join();
+
+    ASSERT_EQ(publications, handle.version());
+}